@@ -21,6 +21,9 @@
 #include <sched.h>
 #include <dlfcn.h>
 #include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 #include "bfrun.h"
 #include "bfconf.h"
@@ -38,6 +41,7 @@
 #include "pinfo.h"
 #include "numunion.h"
 #include "delay.h"
+#include "textparse.h"
 
 #define PATH_SEPARATOR_CHAR '/'
 #define PATH_SEPARATOR_STR "/"
@@ -52,6 +56,33 @@ struct bflex {
     union bflexval lexval;
 };
 
+/* everything that affects the preprocessed coefficients */
+struct coeff_cache_key {
+    uint64_t content_hash;
+    int32_t version;
+    int32_t filter_length;
+    int32_t realsize;
+    int32_t n_blocks;
+    int32_t format;
+    int32_t skip;
+    int32_t raw_isfloat;
+    int32_t raw_swap;
+    int32_t raw_bytes;
+    int32_t raw_sbytes;
+    int32_t raw_format;
+    double raw_scale;
+    double scale;
+};
+
+#define COEFF_CACHE_MAGIC 0x43464642 /* "BFFC" */
+#define COEFF_CACHE_HEADER_SIZE 4096
+
+struct coeff_cache_header {
+    uint32_t magic;
+    int32_t cbufsize;
+    struct coeff_cache_key key;
+};
+
 struct coeff {
     struct bfcoeff coeff;
 #define COEFF_FORMAT_RAW 1    
@@ -66,14 +97,24 @@ struct coeff {
     int shm_blocks[BF_MAXCOEFFPARTS];
     int shm_elements;
     double scale;
+    bool_t lazy;
+    bool_t reloadable;
+    int duplicate_of;
+    dev_t file_dev;
+    ino_t file_ino;
+    bool_t use_cache;
+    struct coeff_cache_key cache_key;
+    char cache_path[PATH_MAX];
+    int cache_errno;
+    void **cached_cbuf;
 };
 
 struct filter {
     struct bffilter filter;
     struct bffilter_control fctrl;
     char coeff_name[BF_MAXOBJECTNAME];
-    char *channel_name[2][BF_MAXCHANNELS];
-    char *filter_name[2][BF_MAXCHANNELS];
+    char **channel_name[2];
+    char **filter_name[2];
     int process;
 };
 
@@ -106,6 +147,8 @@ static struct bflex *logic_params[BF_MAXMODULES];
 static struct bflex *config_params;
 static int config_params_pos;
 static bool_t has_defaults = false;
+static struct earena *coeff_arena = NULL;
+static struct coeff **runtime_coeffs = NULL;
 
 #define FROM_DB(db) (pow(10, (db) / 20.0))
 
@@ -204,7 +247,15 @@ monitor_rate: false;        # monitor sample rate\n\
 powersave: false;           # pause filtering when input is zero\n\
 lock_memory: true;          # try to lock memory if realtime prio is set\n\
 sdf_length: -1;             # subsample filter half length in samples\n\
-safety_limit: 20;           # if non-zero max dB in output before aborting\n"
+freqd_subdelay: false;      # apply subsample delays in the frequency domain\n\
+safety_limit: 20;           # if non-zero max dB in output before aborting\n\
+pipelined: false;           # overlap processing stages, one block extra delay\n\
+hugepages: false;           # use huge pages for large shared buffers\n\
+cache_stagger: false;       # pad buffers to avoid cache set aliasing\n\
+coeff_cache: \"\";            # directory for preprocessed coefficients\n\
+lazy_coeff_memory: 0;       # max MB for lazy coefficients, 0 = no limit\n\
+meter_rate: 0;              # level meter updates per second, 0 = off\n\
+delay_ramp: 0;              # ms to ramp delay changes over, 0 = jump\n"
 #ifdef CONVOLVER_NEEDS_CONFIGFILE
 	    "convolver_config: \"~/.brutefir_convolver\"; # location of "
 	    "convolver config file\n"
@@ -218,6 +269,8 @@ coeff {\n\
 \tblocks: -1;         # how long in blocks\n\
 \tskip: 0;            # how many bytes to skip\n\
 \tshared_mem: false;  # allocate in shared memory\n\
+\tlazy: false;        # load when first used\n\
+\treloadable: false;  # can be reloaded at runtime\n\
 };\n\
 \n\
 ## INPUT DEFAULTS ##\n\
@@ -834,6 +887,16 @@ parse_coeff(bool_t parse_default,
 		get_token(REAL);
 		coeff->skip = make_integer(yylval.real);
 		get_token(EOS);
+	    } else if (strcmp(yylval.field, "lazy") == 0) {
+		field_repeat_test(&bitset, 6);
+		get_token(BOOLEAN);
+		coeff->lazy = yylval.boolean;
+		get_token(EOS);
+	    } else if (strcmp(yylval.field, "reloadable") == 0) {
+		field_repeat_test(&bitset, 7);
+		get_token(BOOLEAN);
+		coeff->reloadable = yylval.boolean;
+		get_token(EOS);
 	    } else {
 		unrecognised_token("coeff field", yylval.field);
 	    }
@@ -885,9 +948,11 @@ parse_filter_io_array(struct filter *filter,
 		      int io,
 		      bool_t isfilter)
 {
-    int len = 0, token;
+    int len = 0, cap = 0, token;
     char name[BF_MAXOBJECTNAME];
-    int io_array[BF_MAXCHANNELS];
+    int *io_array = NULL;
+    double *scale = NULL;
+    char **names = NULL;
     char msg[200];
 
     if (parse_default) {
@@ -900,27 +965,20 @@ parse_filter_io_array(struct filter *filter,
 	if (len == BF_MAXCHANNELS) {
 	    parse_error("array is too long.\n");
 	}
+        if (len == cap) {
+            /* grown as needed, arrays are usually short */
+            cap = (cap == 0) ? 16 : 2 * cap;
+            io_array = erealloc(io_array, cap * sizeof(int));
+            scale = erealloc(scale, cap * sizeof(double));
+            names = erealloc(names, cap * sizeof(char *));
+        }
 	if (!get_string_or_int(name, BF_MAXOBJECTNAME, &io_array[len])) {
 	    io_array[len] = 0;
-	    if (isfilter) {
-		filter->filter_name[io][len] = estrdup(name);
-	    } else {
-		filter->channel_name[io][len] = estrdup(name);
-	    }
+            names[len] = estrdup(name);
 	} else {
-	    if (isfilter) {
-                filter->filter_name[io][len] = NULL;
-            } else {
-                filter->channel_name[io][len] = NULL;            
-            }
-        }
-        if (isfilter) {
-            if (io == IN) {
-                filter->fctrl.fscale[len] = 1.0;
-            }
-        } else {
-            filter->fctrl.scale[io][len] = 1.0;
+            names[len] = NULL;
         }
+        scale[len] = 1.0;
 	switch (token = yylex()) {
 	case SLASH:
 	    if (io == OUT && isfilter) {
@@ -931,11 +989,7 @@ parse_filter_io_array(struct filter *filter,
             case SLASH:
                 goto parse_scalar;
             case REAL:
-                if (isfilter) {
-                    filter->fctrl.fscale[len] *= FROM_DB(-yylval.real);
-                } else {
-                    filter->fctrl.scale[io][len] *= FROM_DB(-yylval.real);
-                }
+                scale[len] *= FROM_DB(-yylval.real);
                 switch (token = yylex()) {
                 case EOS:
                 case COMMA:
@@ -943,11 +997,7 @@ parse_filter_io_array(struct filter *filter,
                 case SLASH:
                 parse_scalar:
                     get_token(REAL);
-                    if (isfilter) {
-                        filter->fctrl.fscale[len] *= yylval.real;
-                    } else {
-                        filter->fctrl.scale[io][len] *= yylval.real;
-                    }
+                    scale[len] *= yylval.real;
                     switch (token = yylex()) {
                     case EOS:
                     case COMMA:
@@ -971,15 +1021,29 @@ parse_filter_io_array(struct filter *filter,
 	len++;
     } while (token != EOS);
 
+    /* only store as many names and scales as there are connections */
     if (isfilter) {
 	filter->filter.n_filters[io] = len;
 	filter->filter.filters[io] = emalloc(len * sizeof(int));
 	memcpy(filter->filter.filters[io], io_array, len * sizeof(int));
+	filter->filter_name[io] = emalloc(len * sizeof(char *));
+	memcpy(filter->filter_name[io], names, len * sizeof(char *));
+        if (io == IN) {
+            filter->fctrl.fscale = emalloc(len * sizeof(double));
+            memcpy(filter->fctrl.fscale, scale, len * sizeof(double));
+        }
     } else {
 	filter->filter.n_channels[io] = len;
 	filter->filter.channels[io] = emalloc(len * sizeof(int));
 	memcpy(filter->filter.channels[io], io_array, len * sizeof(int));
+	filter->channel_name[io] = emalloc(len * sizeof(char *));
+	memcpy(filter->channel_name[io], names, len * sizeof(char *));
+        filter->fctrl.scale[io] = emalloc(len * sizeof(double));
+        memcpy(filter->fctrl.scale[io], scale, len * sizeof(double));
     }
+    efree(io_array);
+    efree(scale);
+    efree(names);
 }
 
 static struct filter *
@@ -1633,6 +1697,59 @@ parse_setting(char field[],
             exit(BF_EXIT_INVALID_CONFIG);
         }
 	get_token(EOS);
+    } else if (strcmp(field, "pipelined") == 0) {
+	field_repeat_test(repeat_bitset, 19);
+	get_token(BOOLEAN);
+	bfconf->pipelined = yylval.boolean;
+	get_token(EOS);
+    } else if (strcmp(field, "hugepages") == 0) {
+	field_repeat_test(repeat_bitset, 20);
+	get_token(BOOLEAN);
+	bfconf->hugepages = yylval.boolean;
+	get_token(EOS);
+    } else if (strcmp(field, "cache_stagger") == 0) {
+	field_repeat_test(repeat_bitset, 21);
+	get_token(BOOLEAN);
+	bfconf->cache_stagger = yylval.boolean;
+	get_token(EOS);
+    } else if (strcmp(field, "coeff_cache") == 0) {
+	field_repeat_test(repeat_bitset, 22);
+	get_token(STRING);
+        efree(bfconf->coeff_cache);
+        bfconf->coeff_cache = NULL;
+        if (yylval.string[0] != '\0') {
+            bfconf->coeff_cache = estrdup(tilde_expansion(yylval.string));
+        }
+	get_token(EOS);
+    } else if (strcmp(field, "lazy_coeff_memory") == 0) {
+	field_repeat_test(repeat_bitset, 23);
+	get_token(REAL);
+        if (yylval.real < 0) {
+            parse_error("lazy_coeff_memory must not be negative.\n");
+        }
+	bfconf->lazy_coeff_memory = (size_t)(yylval.real * 1024.0 * 1024.0);
+	get_token(EOS);
+    } else if (strcmp(field, "meter_rate") == 0) {
+	field_repeat_test(repeat_bitset, 24);
+	get_token(REAL);
+        if (yylval.real < 0) {
+            parse_error("meter_rate must not be negative.\n");
+        }
+	bfconf->meter_rate = yylval.real;
+	get_token(EOS);
+    } else if (strcmp(field, "freqd_subdelay") == 0) {
+	field_repeat_test(repeat_bitset, 25);
+	get_token(BOOLEAN);
+	bfconf->freqd_subdelay = yylval.boolean;
+	get_token(EOS);
+    } else if (strcmp(field, "delay_ramp") == 0) {
+	field_repeat_test(repeat_bitset, 26);
+	get_token(REAL);
+        if (yylval.real < 0) {
+            parse_error("delay_ramp must not be negative.\n");
+        }
+	bfconf->delay_ramp = yylval.real;
+	get_token(EOS);
     } else {
 	parse_error("unrecognised setting name.\n");
     }
@@ -1721,6 +1838,80 @@ get_defaults(void)
     field_mandatory_test(repeat_bitset, bits, current_filename);
 }
 
+/* Parse a text file of numbers, one per line, by mapping it into memory. There
+   cannot be more numbers than lines, so the buffer is allocated after counting
+   them. Returns NULL if the file cannot be mapped, for example if it is a
+   pipe. */
+static void *
+real_read_mapped(FILE *stream,
+                 int *len,
+                 char filename[],
+                 int realsize,
+                 int maxitems)
+{
+    const char *base, *p, *s, *end;
+    void *realbuf;
+    struct stat st;
+    int capacity;
+    double value;
+    long offset;
+
+    if ((offset = ftell(stream)) == -1 || fstat(fileno(stream), &st) == -1 ||
+        !S_ISREG(st.st_mode) || st.st_size <= offset)
+    {
+        return NULL;
+    }
+    if ((base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                     fileno(stream), 0)) == MAP_FAILED)
+    {
+        return NULL;
+    }
+    madvise((void *)base, st.st_size, MADV_SEQUENTIAL);
+    end = base + st.st_size;
+    capacity = 1;
+    for (p = base + offset; (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        capacity++;
+    }
+    if (maxitems > 0 && capacity > maxitems) {
+        capacity = maxitems;
+    }
+    realbuf = emalloc(capacity * realsize);
+    *len = 0;
+    p = base + offset;
+    while (p < end && *len < capacity) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == end) {
+            break;
+        }
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+        value = textparse_real(p, end, &s);
+        if (s == p) {
+	    fprintf(stderr, "Parse error on line %d in file %s: invalid "
+		    "floating point number.\n", *len + 1, filename);
+	    exit(BF_EXIT_INVALID_CONFIG);
+        }
+        if (realsize == 4) {
+            ((float *)realbuf)[*len] = (float)value;
+        } else {
+            ((double *)realbuf)[*len] = value;
+        }
+        (*len) += 1;
+        /* anything after the number is ignored */
+        if ((p = memchr(s, '\n', end - s)) == NULL) {
+            break;
+        }
+        p++;
+    }
+    munmap((void *)base, st.st_size);
+    if (*len > 0 && *len < capacity) {
+        realbuf = erealloc(realbuf, (*len) * realsize);
+    }
+    return realbuf;
+}
+
 static void *
 real_read(FILE *stream,
           int *len,
@@ -1732,6 +1923,11 @@ real_read(FILE *stream,
     void *realbuf = NULL;
     int capacity = 0;
     
+    if ((realbuf = real_read_mapped(stream, len, filename, realsize,
+                                    maxitems)) != NULL)
+    {
+        return realbuf;
+    }
     *len = 0;
 
     str[1023] = '\0';
@@ -1863,17 +2059,233 @@ get_sharedmem(int shmid,
     return (void *)&((uint8_t *)buf)[offset];
 }
 
+/* Buffers with power of two sizes placed back to back map to the same cache
+   sets, so when convolving the input, coefficient and output blocks evict
+   each other. To avoid that, each buffer is padded with a cache line, and
+   each stream of buffers starts at a different offset within a cache way. */
+static void
+set_cache_stagger(void)
+{
+    long line_size = -1, cache_size = -1, assoc = -1;
+    int way_size;
+
+    bfconf->stagger_size = 0;
+    bfconf->stagger_offset = 0;
+    if (!bfconf->cache_stagger) {
+        return;
+    }
+#ifdef _SC_LEVEL1_DCACHE_LINESIZE
+    line_size = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    cache_size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    assoc = sysconf(_SC_LEVEL1_DCACHE_ASSOC);
+#endif
+    if (line_size < ALIGNMENT) {
+        line_size = line_size <= 0 ? 64 : ALIGNMENT;
+    }
+    if (cache_size <= 0 || assoc <= 0 || cache_size / assoc < line_size) {
+        way_size = 4096;
+    } else {
+        way_size = cache_size / assoc;
+    }
+    bfconf->stagger_size = line_size;
+    bfconf->stagger_offset = (way_size / 3) & ~(line_size - 1);
+    pinfo("Cache stagger is %d bytes (cache way size %d bytes).\n",
+          bfconf->stagger_size, way_size);
+}
+
+/* Look up a coefficient set in the coefficient cache. The cache is indexed by
+   a hash of the file contents and the parameters that affect preprocessing,
+   and cached sets are mapped read-only so they are shared between processes
+   and with later runs. If not found, the key is kept so the set can be stored
+   after it has been preprocessed. */
+static void
+coeff_cache_lookup(struct coeff *coeff)
+{
+    struct coeff_cache_header *header;
+    struct stat filestat;
+    uint64_t hash;
+    uint8_t *p;
+    size_t size;
+    int fd, n;
+
+    coeff->use_cache = false;
+    coeff->cached_cbuf = NULL;
+    if (bfconf->coeff_cache == NULL || coeff->coeff.is_shared ||
+        coeff->shm_elements > 0 || coeff->format == COEFF_FORMAT_PROCESSED ||
+        strcmp(coeff->filename, "dirac pulse") == 0)
+    {
+        return;
+    }
+
+    /* hash the file contents */
+    if ((fd = open(coeff->filename, O_RDONLY)) == -1 ||
+        fstat(fd, &filestat) == -1)
+    {
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    hash = UINT64_C(0xcbf29ce484222325);
+    if (filestat.st_size > 0) {
+        if ((p = mmap(NULL, filestat.st_size, PROT_READ, MAP_SHARED, fd, 0))
+            == MAP_FAILED)
+        {
+            close(fd);
+            return;
+        }
+        for (size = 0; size < filestat.st_size; size++) {
+            hash = (hash ^ p[size]) * UINT64_C(0x100000001b3);
+        }
+        munmap(p, filestat.st_size);
+    }
+    close(fd);
+
+    memset(&coeff->cache_key, 0, sizeof(struct coeff_cache_key));
+    coeff->cache_key.content_hash = hash;
+    coeff->cache_key.version = CONVOLVER_CBUF_FORMAT_VERSION;
+    coeff->cache_key.filter_length = bfconf->filter_length;
+    coeff->cache_key.realsize = bfconf->realsize;
+    coeff->cache_key.n_blocks = coeff->coeff.n_blocks;
+    coeff->cache_key.format = coeff->format;
+    coeff->cache_key.skip = coeff->skip;
+    coeff->cache_key.raw_isfloat = coeff->rawformat.isfloat;
+    coeff->cache_key.raw_swap = coeff->rawformat.swap;
+    coeff->cache_key.raw_bytes = coeff->rawformat.bytes;
+    coeff->cache_key.raw_sbytes = coeff->rawformat.sbytes;
+    coeff->cache_key.raw_format = coeff->rawformat.format;
+    coeff->cache_key.raw_scale = coeff->rawformat.scale;
+    coeff->cache_key.scale = coeff->scale;
+    p = (uint8_t *)&coeff->cache_key;
+    for (n = 0; n < sizeof(struct coeff_cache_key); n++) {
+        hash = (hash ^ p[n]) * UINT64_C(0x100000001b3);
+    }
+    snprintf(coeff->cache_path, PATH_MAX, "%s/%016" PRIx64 ".bfc",
+             bfconf->coeff_cache, hash);
+    coeff->use_cache = true;
+
+    /* map the cached set if there is one */
+    size = COEFF_CACHE_HEADER_SIZE +
+        (size_t)coeff->coeff.n_blocks * convolver_cbufsize();
+    if ((fd = open(coeff->cache_path, O_RDONLY)) == -1) {
+        return;
+    }
+    if (fstat(fd, &filestat) == -1 || filestat.st_size != size ||
+        (p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        close(fd);
+        return;
+    }
+    close(fd);
+    header = (struct coeff_cache_header *)p;
+    if (header->magic != COEFF_CACHE_MAGIC ||
+        header->cbufsize != convolver_cbufsize() ||
+        memcmp(&header->key, &coeff->cache_key,
+               sizeof(struct coeff_cache_key)) != 0)
+    {
+        munmap(p, size);
+        return;
+    }
+    coeff->cached_cbuf = emalloc(coeff->coeff.n_blocks * sizeof(void *));
+    for (n = 0; n < coeff->coeff.n_blocks; n++) {
+        coeff->cached_cbuf[n] = &p[COEFF_CACHE_HEADER_SIZE +
+                                   n * convolver_cbufsize()];
+    }
+}
+
+/* Unmap a cached set mapped by coeff_cache_lookup(). */
+static void
+coeff_cache_release(struct coeff *coeff)
+{
+    if (coeff->cached_cbuf == NULL) {
+        return;
+    }
+    munmap((uint8_t *)coeff->cached_cbuf[0] - COEFF_CACHE_HEADER_SIZE,
+           COEFF_CACHE_HEADER_SIZE +
+           (size_t)coeff->coeff.n_blocks * convolver_cbufsize());
+    efree(coeff->cached_cbuf);
+    coeff->cached_cbuf = NULL;
+}
+
+/* Failures are not printed here since the store may be done in a load worker
+   process, they are saved in 'cache_errno' and reported with
+   coeff_cache_report() by the process that owns the terminal. */
+static void
+coeff_cache_store(struct coeff *coeff,
+                  void **cbuf)
+{
+    struct coeff_cache_header *header;
+    char tmppath[PATH_MAX + 16];
+    FILE *stream;
+    int n;
+
+    coeff->cache_errno = 0;
+    mkdir(bfconf->coeff_cache, 0755);
+    n = snprintf(tmppath, sizeof(tmppath), "%s.%d", coeff->cache_path,
+                 (int)getpid());
+    if (n < 0 || n >= (int)sizeof(tmppath)) {
+        coeff->cache_errno = ENAMETOOLONG;
+        return;
+    }
+    if ((stream = fopen(tmppath, "wb")) == NULL) {
+        coeff->cache_errno = errno;
+        return;
+    }
+    header = alloca(COEFF_CACHE_HEADER_SIZE);
+    memset(header, 0, COEFF_CACHE_HEADER_SIZE);
+    header->magic = COEFF_CACHE_MAGIC;
+    header->cbufsize = convolver_cbufsize();
+    header->key = coeff->cache_key;
+    if (fwrite(header, COEFF_CACHE_HEADER_SIZE, 1, stream) != 1) {
+        goto store_error;
+    }
+    for (n = 0; n < coeff->coeff.n_blocks; n++) {
+        if (fwrite(cbuf[n], convolver_cbufsize(), 1, stream) != 1) {
+            goto store_error;
+        }
+    }
+    if (fclose(stream) != 0) {
+        stream = NULL;
+        goto store_error;
+    }
+    if (rename(tmppath, coeff->cache_path) == -1) {
+        stream = NULL;
+        goto store_error;
+    }
+    return;
+
+ store_error:
+    coeff->cache_errno = errno;
+    if (stream != NULL) {
+        fclose(stream);
+    }
+    unlink(tmppath);
+}
+
+static void
+coeff_cache_report(struct coeff *coeff)
+{
+    if (coeff->cache_errno != 0) {
+        pinfo("Warning: could not write coefficient cache file \"%s\": "
+              "%s.\n", coeff->cache_path, strerror(coeff->cache_errno));
+        coeff->cache_errno = 0;
+    }
+}
+
 static void *
 load_coeff(struct coeff *coeff,
            int cindex,
-           int realsize)
+           int realsize,
+           uint8_t *dest)
 {
     void *coeffs, *zbuf = NULL;
     FILE *stream = NULL;
     void **cbuf, *buf;
-    int n, i, j, len;
-    uint8_t *dest;
+    int n, i, j, len, blocksize;
 
+    if (coeff->cached_cbuf != NULL) {
+        return coeff->cached_cbuf;
+    }
     if (coeff->shm_elements <= 0 &&
 	strcmp(coeff->filename, "dirac pulse") != 0)
     {
@@ -1949,6 +2361,7 @@ load_coeff(struct coeff *coeff,
 			    coeff->coeff.n_blocks * convolver_cbufsize(), len);
 		    exit(BF_EXIT_INVALID_CONFIG);
 		}
+                emalloc_account(EMALLOC_CAT_COEFFS, len);
 		for (n = 0; n < coeff->coeff.n_blocks; n++) {
 		    cbuf[n] =
                         (void *)&((uint8_t *)buf)[n * convolver_cbufsize()];
@@ -1979,15 +2392,7 @@ load_coeff(struct coeff *coeff,
 	zbuf = emalloc(bfconf->filter_length * realsize);
 	memset(zbuf, 0, bfconf->filter_length * realsize);
     }
-    if (coeff->coeff.is_shared) {
-        dest = shmalloc(2 * coeff->coeff.n_blocks * bfconf->filter_length *
-                        realsize);
-        if (dest == NULL) {
-            exit(BF_EXIT_NO_MEMORY);
-        }
-    } else {
-        dest = NULL;
-    }
+    blocksize = 2 * bfconf->filter_length * realsize + bfconf->stagger_size;
     for (n = 0; n < coeff->coeff.n_blocks; n++) {
 	if (n * bfconf->filter_length > len) {
 	    cbuf[n] = convolver_coeffs2cbuf(zbuf,
@@ -2012,12 +2417,13 @@ load_coeff(struct coeff *coeff,
 		    coeff->filename);
 	    exit(BF_EXIT_OTHER);
 	}
-        if (coeff->coeff.is_shared) {
-            dest += 2 * bfconf->filter_length * realsize;
-        }
+        dest += blocksize;
     }
     efree(zbuf);
     efree(coeffs);
+    if (coeff->use_cache) {
+        coeff_cache_store(coeff, cbuf);
+    }
 #if 0    
     if (bfconf->debug) {
         char filename[1024];                
@@ -2028,6 +2434,386 @@ load_coeff(struct coeff *coeff,
     return cbuf;
 }
 
+static bool_t
+can_share_coeff(struct coeff *coeff)
+{
+    return !coeff->lazy && !coeff->reloadable && !coeff->coeff.is_shared &&
+        coeff->shm_elements <= 0;
+}
+
+static bool_t
+same_file_contents(const char path1[],
+                   const char path2[])
+{
+    struct stat st1, st2;
+    uint8_t *p1, *p2;
+    bool_t same;
+    int fd1, fd2;
+
+    same = false;
+    fd1 = open(path1, O_RDONLY);
+    fd2 = open(path2, O_RDONLY);
+    if (fd1 != -1 && fd2 != -1 && fstat(fd1, &st1) == 0 &&
+        fstat(fd2, &st2) == 0 && st1.st_size == st2.st_size)
+    {
+        if (st1.st_size == 0) {
+            same = true;
+        } else if ((p1 = mmap(NULL, st1.st_size, PROT_READ, MAP_SHARED, fd1,
+                              0)) != MAP_FAILED)
+        {
+            if ((p2 = mmap(NULL, st2.st_size, PROT_READ, MAP_SHARED, fd2, 0))
+                != MAP_FAILED)
+            {
+                same = memcmp(p1, p2, st1.st_size) == 0;
+                munmap(p2, st2.st_size);
+            }
+            munmap(p1, st1.st_size);
+        }
+    }
+    if (fd1 != -1) {
+        close(fd1);
+    }
+    if (fd2 != -1) {
+        close(fd2);
+    }
+    return same;
+}
+
+/* Find an earlier coefficient set with the same contents as 'cindex', either
+   by it being the same file with the same settings, or by the content hash
+   from the cache lookup, confirmed by comparing the files. Returns its index,
+   or -1 if there is none. */
+static int
+find_identical_coeff(struct coeff *coeffs[],
+                     int cindex,
+                     bool_t by_content)
+{
+    struct coeff *c, *o;
+    int n;
+
+    c = coeffs[cindex];
+    if (!can_share_coeff(c)) {
+        return -1;
+    }
+    for (n = 0; n < cindex; n++) {
+        o = coeffs[n];
+        if (!can_share_coeff(o) || o->duplicate_of != -1 ||
+            o->coeff.n_blocks != c->coeff.n_blocks ||
+            o->format != c->format || o->skip != c->skip ||
+            o->scale != c->scale ||
+            o->rawformat.isfloat != c->rawformat.isfloat ||
+            o->rawformat.swap != c->rawformat.swap ||
+            o->rawformat.bytes != c->rawformat.bytes ||
+            o->rawformat.sbytes != c->rawformat.sbytes ||
+            o->rawformat.format != c->rawformat.format ||
+            o->rawformat.scale != c->rawformat.scale)
+        {
+            continue;
+        }
+        if (by_content) {
+            /* the key is only a hash of the contents, so compare them too */
+            if (c->use_cache && o->use_cache &&
+                memcmp(&c->cache_key, &o->cache_key,
+                       sizeof(struct coeff_cache_key)) == 0 &&
+                same_file_contents(c->filename, o->filename))
+            {
+                return n;
+            }
+        } else if (strcmp(c->filename, o->filename) == 0 ||
+                   (c->file_ino != 0 && c->file_dev == o->file_dev &&
+                    c->file_ino == o->file_ino))
+        {
+            return n;
+        }
+    }
+    return -1;
+}
+
+/* Coefficients that are loaded at runtime are read from file, into memory
+   that is set up at startup. */
+static void
+check_runtime_coeff(struct coeff *coeff,
+                    int cindex)
+{
+    if (coeff->coeff.is_shared || coeff->shm_elements > 0 ||
+        coeff->format == COEFF_FORMAT_PROCESSED ||
+        strcmp(coeff->filename, "dirac pulse") == 0)
+    {
+        fprintf(stderr, "Coeff %d: only coefficients read and processed "
+                "from file can be lazily loaded or reloaded.\n", cindex);
+        exit(BF_EXIT_INVALID_CONFIG);
+    }
+    if (coeff->lazy && coeff->reloadable) {
+        fprintf(stderr, "Coeff %d: cannot be both lazily loaded and "
+                "reloadable.\n", cindex);
+        exit(BF_EXIT_INVALID_CONFIG);
+    }
+}
+
+/* Set up shared memory for lazily loaded coefficients: a state per coefficient
+   set, block pointer arrays, and a number of slots with room for the largest
+   lazy coefficient set each. The slots are filled and evicted by the lazy
+   loader process. */
+static void
+init_lazy_coeffs(struct coeff *coeffs[])
+{
+    int n, n_lazy, n_pointers, max_blocks, blocksize;
+    size_t size;
+    void **pointers;
+    uint8_t *p;
+
+    for (n = n_lazy = n_pointers = max_blocks = 0; n < bfconf->n_coeffs; n++) {
+        if (!coeffs[n]->lazy) {
+            continue;
+        }
+        check_runtime_coeff(coeffs[n], n);
+        n_lazy++;
+        n_pointers += coeffs[n]->coeff.n_blocks;
+        if (coeffs[n]->coeff.n_blocks > max_blocks) {
+            max_blocks = coeffs[n]->coeff.n_blocks;
+        }
+    }
+    if (n_lazy == 0) {
+        return;
+    }
+    blocksize = convolver_cbufsize() + bfconf->stagger_size;
+    bfconf->lazy_slot_size = max_blocks * blocksize;
+    bfconf->n_lazy_slots = n_lazy;
+    if (bfconf->lazy_coeff_memory > 0 &&
+        bfconf->lazy_coeff_memory / bfconf->lazy_slot_size < n_lazy)
+    {
+        bfconf->n_lazy_slots =
+            bfconf->lazy_coeff_memory / bfconf->lazy_slot_size;
+        if (bfconf->n_lazy_slots < 1) {
+            bfconf->n_lazy_slots = 1;
+        }
+    }
+    size = bfconf->n_coeffs * sizeof(int) + n_pointers * sizeof(void *);
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if ((p = shmalloc(size + (size_t)bfconf->n_lazy_slots *
+                      bfconf->lazy_slot_size)) == NULL)
+    {
+        exit(BF_EXIT_NO_MEMORY);
+    }
+    memset(p, 0, size);
+    emalloc_account(EMALLOC_CAT_COEFFS,
+                    (size_t)bfconf->n_lazy_slots * bfconf->lazy_slot_size);
+    bfconf->coeff_state = (volatile int *)p;
+    pointers = (void **)&p[bfconf->n_coeffs * sizeof(int)];
+    bfconf->lazy_slots = &p[size];
+    for (n = 0; n < bfconf->n_coeffs; n++) {
+        if (!coeffs[n]->lazy) {
+            continue;
+        }
+        runtime_coeffs[n] = coeffs[n];
+        bfconf->coeff_state[n] = BF_COEFF_UNLOADED;
+        bfconf->coeffs_data[n] = pointers;
+        pointers += coeffs[n]->coeff.n_blocks;
+    }
+}
+
+/* Give each reloadable coefficient set a spare block area in shared memory,
+   and move its block pointers to shared memory, so the loader process can
+   swap them. */
+static void
+init_reloadable_coeffs(struct coeff *coeffs[])
+{
+    int n, i, n_blocks, n_pointers, blocksize;
+    size_t size;
+    void **pointers;
+    uint8_t *p;
+
+    for (n = n_blocks = 0; n < bfconf->n_coeffs; n++) {
+        if (coeffs[n]->reloadable) {
+            check_runtime_coeff(coeffs[n], n);
+            n_blocks += coeffs[n]->coeff.n_blocks;
+        }
+    }
+    if (n_blocks == 0) {
+        return;
+    }
+    blocksize = convolver_cbufsize() + bfconf->stagger_size;
+    n_pointers = 2 * n_blocks;
+    size = (n_pointers * sizeof(void *) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if ((p = shmalloc(size + (size_t)n_blocks * blocksize)) == NULL) {
+        exit(BF_EXIT_NO_MEMORY);
+    }
+    emalloc_account(EMALLOC_CAT_COEFFS, (size_t)n_blocks * blocksize);
+    pointers = (void **)p;
+    p = &p[size];
+    bfconf->coeffs_spare = emalloc(bfconf->n_coeffs * sizeof(void **));
+    for (n = 0; n < bfconf->n_coeffs; n++) {
+        bfconf->coeffs_spare[n] = NULL;
+        if (!coeffs[n]->reloadable) {
+            continue;
+        }
+        runtime_coeffs[n] = coeffs[n];
+        memcpy(pointers, bfconf->coeffs_data[n],
+               coeffs[n]->coeff.n_blocks * sizeof(void *));
+        efree(bfconf->coeffs_data[n]);
+        bfconf->coeffs_data[n] = pointers;
+        pointers += coeffs[n]->coeff.n_blocks;
+        for (i = 0; i < coeffs[n]->coeff.n_blocks; i++) {
+            pointers[i] = &p[i * blocksize];
+        }
+        bfconf->coeffs_spare[n] = pointers;
+        pointers += coeffs[n]->coeff.n_blocks;
+        p += coeffs[n]->coeff.n_blocks * blocksize;
+    }
+}
+
+void
+bfconf_load_coeff(int cindex,
+                  const char filename[],
+                  uint8_t *dest)
+{
+    struct coeff *coeff;
+    int n, blocksize;
+
+    coeff = runtime_coeffs[cindex];
+    if (filename != NULL) {
+        strncpy(coeff->filename, filename, PATH_MAX);
+        coeff->filename[PATH_MAX - 1] = '\0';
+    }
+    blocksize = convolver_cbufsize() + bfconf->stagger_size;
+    coeff_cache_lookup(coeff);
+    if (coeff->cached_cbuf != NULL) {
+        for (n = 0; n < coeff->coeff.n_blocks; n++) {
+            memcpy(&dest[n * blocksize], coeff->cached_cbuf[n],
+                   convolver_cbufsize());
+        }
+        coeff_cache_release(coeff);
+        return;
+    }
+    load_coeff(coeff, cindex, bfconf->realsize, dest);
+    coeff_cache_report(coeff);
+}
+
+struct coeff_load_status {
+    bool_t done;
+    int cache_errno;
+    double time_ms;
+};
+
+/* Load and preprocess the coefficients. Coefficients that need to be
+   transformed are spread over a pool of worker processes, writing directly
+   to their preallocated shared destination memory. Any coefficient that a
+   worker did not finish is then loaded here in the parent, in index order, so
+   errors are reported exactly as when loading sequentially. */
+static void
+load_coeffs(struct coeff *coeffs[],
+            uint8_t *dests[])
+{
+    volatile struct coeff_load_status *status = NULL;
+    volatile int *next_coeff = NULL;
+    int n, i, n_workers, n_parallel, blocksize, wstatus;
+    struct timeval tv1, tv2;
+    pid_t pid;
+
+    blocksize = convolver_cbufsize() + bfconf->stagger_size;
+    for (n = n_parallel = 0; n < bfconf->n_coeffs; n++) {
+        if (dests[n] != NULL) {
+            n_parallel++;
+        }
+    }
+    n_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_workers > n_parallel) {
+        n_workers = n_parallel;
+    }
+    if (n_workers > 1) {
+        pid_t workers[n_workers];
+
+        if ((status = shmalloc(bfconf->n_coeffs *
+                               sizeof(struct coeff_load_status) +
+                               sizeof(int))) == NULL)
+        {
+            exit(BF_EXIT_NO_MEMORY);
+        }
+        memset((void *)status, 0,
+               bfconf->n_coeffs * sizeof(struct coeff_load_status));
+        next_coeff = (volatile int *)&status[bfconf->n_coeffs];
+        *next_coeff = 0;
+        fflush(stdout);
+        fflush(stderr);
+        for (i = 0; i < n_workers; i++) {
+            if ((pid = fork()) == -1) {
+                /* the rest is loaded sequentially below */
+                break;
+            }
+            if (pid != 0) {
+                workers[i] = pid;
+                continue;
+            }
+            /* errors are reported by the parent, load errors when it loads
+               the coefficient again, cache errors through the status */
+            freopen("/dev/null", "w", stderr);
+            while ((n = __sync_fetch_and_add(next_coeff, 1)) <
+                   bfconf->n_coeffs)
+            {
+                if (dests[n] == NULL) {
+                    continue;
+                }
+                gettimeofday(&tv1, NULL);
+                load_coeff(coeffs[n], n, bfconf->realsize, dests[n]);
+                gettimeofday(&tv2, NULL);
+                timersub(&tv2, &tv1, &tv2);
+                status[n].time_ms = (double)tv2.tv_sec * 1000.0 +
+                    (double)tv2.tv_usec / 1000.0;
+                status[n].cache_errno = coeffs[n]->cache_errno;
+                status[n].done = true;
+            }
+            _exit(0);
+        }
+        /* a failed worker leaves its coefficient without the done flag, it
+           is then loaded below where the error is reported */
+        n_workers = i;
+        for (i = 0; i < n_workers; i++) {
+            while (waitpid(workers[i], &wstatus, 0) == -1) {
+                if (errno != EINTR) {
+                    fprintf(stderr, "Failed to wait for coefficient loader: "
+                            "%s.\n", strerror(errno));
+                    exit(BF_EXIT_OTHER);
+                }
+            }
+            if ((!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) &&
+                bfconf->debug)
+            {
+                fprintf(stderr, "coefficient loader %d failed, remaining "
+                        "coefficients are loaded sequentially.\n",
+                        (int)workers[i]);
+            }
+        }
+    }
+    for (n = 0; n < bfconf->n_coeffs; n++) {
+        if (coeffs[n]->lazy || coeffs[n]->duplicate_of != -1) {
+            continue;
+        }
+        if (status != NULL && status[n].done) {
+            bfconf->coeffs_data[n] =
+                emalloc(coeffs[n]->coeff.n_blocks * sizeof(void *));
+            for (i = 0; i < coeffs[n]->coeff.n_blocks; i++) {
+                bfconf->coeffs_data[n][i] = &dests[n][i * blocksize];
+            }
+            tv2.tv_sec = 0;
+            tv2.tv_usec = (long)(status[n].time_ms * 1000.0);
+            coeffs[n]->cache_errno = status[n].cache_errno;
+        } else {
+            gettimeofday(&tv1, NULL);
+            bfconf->coeffs_data[n] =
+                load_coeff(coeffs[n], n, bfconf->realsize, dests[n]);
+            gettimeofday(&tv2, NULL);
+            timersub(&tv2, &tv1, &tv2);
+        }
+        coeff_cache_report(coeffs[n]);
+        if (bfconf->debug) {
+            fprintf(stderr, "coeff %d \"%s\": loaded in %.1f ms%s\n", n,
+                    coeffs[n]->coeff.name,
+                    (double)tv2.tv_sec * 1000.0 + (double)tv2.tv_usec / 1000.0,
+                    coeffs[n]->cached_cbuf != NULL ? " (cached)" : "");
+        }
+    }
+}
+
 static bool_t
 filter_loop(int source_intname,
 	    int search_intname)
@@ -2324,7 +3110,7 @@ bfconf_init(char filename[],
     struct iodev *iodevs[2][BF_MAXCHANNELS];
     struct filter *pfilters[BF_MAXFILTERS];
     struct coeff **coeffs = NULL;
-    struct bffilter filters[BF_MAXFILTERS];
+    struct bffilter *filters;
     struct dither_state *dither_state[BF_MAXCHANNELS];
     struct timeval tv1, tv2;
     int coeffs_capacity = 0;
@@ -2338,7 +3124,11 @@ bfconf_init(char filename[],
     uint32_t used_processes[BF_MAXPROCESSES / 32 + 1];
     uint32_t repeat_bitset = 0;
     int channels[2][BF_MAXCHANNELS];
-    int n, i, j, k, io, token, virtch, physch, maxdelay[2];
+    int n, i, j, k, io, token, virtch, physch, maxdelay[2], blocksize;
+    int n_shared = 0;
+    uint8_t *dest, **dests;
+    size_t size, shared_size = 0;
+    struct stat filestat;
     bool_t load_balance = false;
     uint64_t t1, t2;
     char str[200];
@@ -2433,6 +3223,7 @@ bfconf_init(char filename[],
 	}
     } while (token != EOF);
     fclose(yyin);
+    shmalloc_set_hugepages(bfconf->hugepages);
     
     efree(default_coeff);
     efree(default_filter);
@@ -2792,7 +3583,21 @@ bfconf_init(char filename[],
 /*    }*/
 
     /* init subdelay */
-    if (bfconf->sdf_length < 0) {
+    if (bfconf->freqd_subdelay) {
+        /* The subsample delays are applied as linear phase ramps on the
+           spectra, which is the same as delaying the filter circularly within
+           its FFT block. With a partitioned filter each partition would be
+           wrapped on its own, so it is not allowed. */
+        if (bfconf->n_blocks > 1 &&
+            (bfconf->use_subdelay[IN] || bfconf->use_subdelay[OUT]))
+        {
+            fprintf(stderr, "freqd_subdelay cannot be used with a "
+                    "partitioned filter_length.\n");
+            exit(BF_EXIT_INVALID_CONFIG);
+        }
+        /* no subsample filter, so no extra delay either */
+        bfconf->sdf_length = 0;
+    } else if (bfconf->sdf_length < 0) {
         bfconf->use_subdelay[IN] = false;
         bfconf->use_subdelay[OUT] = false;
     } else if (2 * bfconf->sdf_length + 1 > bfconf->filter_length) {
@@ -2802,7 +3607,9 @@ bfconf_init(char filename[],
                 "2 x sdf_length + 1.\n"); 
 	exit(BF_EXIT_INVALID_CONFIG);
     }
-    if (bfconf->use_subdelay[IN] || bfconf->use_subdelay[OUT]) {
+    if (!bfconf->freqd_subdelay &&
+        (bfconf->use_subdelay[IN] || bfconf->use_subdelay[OUT]))
+    {
         if (!delay_subsample_init(BF_SAMPLE_SLOTS,
                                   bfconf->sdf_length,
                                   bfconf->sdf_beta,
@@ -2815,28 +3622,133 @@ bfconf_init(char filename[],
     }
 
     /* load coefficients */
-    bfconf->coeffs_data = emalloc(bfconf->n_coeffs * sizeof(void **));
+    /* shared, since reloaded coefficients are swapped in by pointer */
+    if ((bfconf->coeffs_data =
+         shmalloc(bfconf->n_coeffs * sizeof(void **) + 1)) == NULL)
+    {
+        exit(BF_EXIT_NO_MEMORY);
+    }
     bfconf->coeffs = emalloc(bfconf->n_coeffs * sizeof(struct bfcoeff));
     if (bfconf->n_coeffs == 1) {
         pinfo("Loading coefficient set...");
     } else if (bfconf->n_coeffs > 1) {
         pinfo("Loading %d coefficient sets...", bfconf->n_coeffs);
     }
-    for (n = 0; n < bfconf->n_coeffs; n++) {
+    /* reserve memory for all preprocessed coefficients at once, shared so
+       that it can be written by the loader processes */
+    for (n = i = 0; n < bfconf->n_coeffs; n++) {
 	if (coeffs[n]->coeff.n_blocks <= 0) {
 	    coeffs[n]->coeff.n_blocks = bfconf->n_blocks;
 	} else if (coeffs[n]->coeff.n_blocks > bfconf->n_blocks) {
 	    fprintf(stderr, "Too many blocks in coeff %d.\n", n);
 	    exit(BF_EXIT_INVALID_CONFIG);
 	}
-	bfconf->coeffs_data[n] = load_coeff(coeffs[n], n, bfconf->realsize);
+        coeffs[n]->duplicate_of = -1;
+        coeffs[n]->file_dev = 0;
+        coeffs[n]->file_ino = 0;
+        if (stat(coeffs[n]->filename, &filestat) == 0) {
+            coeffs[n]->file_dev = filestat.st_dev;
+            coeffs[n]->file_ino = filestat.st_ino;
+        }
+        if (coeffs[n]->lazy) {
+            /* coefficients used from start are loaded directly */
+            for (j = 0; j < bfconf->n_filters; j++) {
+                if (bfconf->initfctrl[j].coeff == n) {
+                    coeffs[n]->lazy = false;
+                    break;
+                }
+            }
+            if (coeffs[n]->lazy) {
+                continue;
+            }
+        }
+        /* identical coefficient sets are loaded once and shared */
+        coeffs[n]->duplicate_of = find_identical_coeff(coeffs, n, false);
+        if (coeffs[n]->duplicate_of == -1 && !coeffs[n]->reloadable) {
+            /* reloadable coefficients must be writable */
+            coeff_cache_lookup(coeffs[n]);
+            coeffs[n]->duplicate_of = find_identical_coeff(coeffs, n, true);
+        }
+        if (coeffs[n]->duplicate_of != -1) {
+            coeff_cache_release(coeffs[n]);
+            shared_size += (size_t)coeffs[n]->coeff.n_blocks *
+                (convolver_cbufsize() + bfconf->stagger_size);
+            n_shared++;
+            continue;
+        }
+        if (coeffs[n]->cached_cbuf != NULL) {
+            emalloc_account(EMALLOC_CAT_COEFFS, COEFF_CACHE_HEADER_SIZE +
+                            (size_t)coeffs[n]->coeff.n_blocks *
+                            convolver_cbufsize());
+        }
+        if (coeffs[n]->format != COEFF_FORMAT_PROCESSED &&
+            coeffs[n]->cached_cbuf == NULL &&
+            !coeffs[n]->coeff.is_shared && !bfconf->hugepages)
+        {
+            i += coeffs[n]->coeff.n_blocks;
+        }
+    }
+    set_cache_stagger();
+    blocksize = convolver_cbufsize() + bfconf->stagger_size;
+    if (i > 0) {
+        size = (size_t)i * blocksize + bfconf->stagger_offset;
+        if ((dest = shmalloc(size)) == NULL) {
+            exit(BF_EXIT_NO_MEMORY);
+        }
+        coeff_arena = earena_new_at(dest, size, EMALLOC_CAT_COEFFS);
+        /* coefficients are the second buffer stream, see set_cache_stagger */
+        earena_alloc(coeff_arena, bfconf->stagger_offset);
+    }
+    runtime_coeffs = emalloc(bfconf->n_coeffs * sizeof(struct coeff *));
+    memset(runtime_coeffs, 0, bfconf->n_coeffs * sizeof(struct coeff *));
+    init_lazy_coeffs(coeffs);
+    dests = emalloc(bfconf->n_coeffs * sizeof(uint8_t *));
+    for (n = 0; n < bfconf->n_coeffs; n++) {
+        dests[n] = NULL;
+        if (coeffs[n]->lazy || coeffs[n]->duplicate_of != -1 ||
+            coeffs[n]->format == COEFF_FORMAT_PROCESSED ||
+            coeffs[n]->cached_cbuf != NULL)
+        {
+            continue;
+        }
+        size = (size_t)coeffs[n]->coeff.n_blocks * blocksize;
+        if (coeffs[n]->coeff.is_shared || bfconf->hugepages) {
+            if ((dests[n] = shmalloc(size)) == NULL) {
+                exit(BF_EXIT_NO_MEMORY);
+            }
+            emalloc_account(EMALLOC_CAT_COEFFS, size);
+        } else {
+            dests[n] = earena_alloc(coeff_arena, size);
+        }
+    }
+    load_coeffs(coeffs, dests);
+    for (n = 0; n < bfconf->n_coeffs; n++) {
+        if (coeffs[n]->duplicate_of != -1) {
+            bfconf->coeffs_data[n] =
+                bfconf->coeffs_data[coeffs[n]->duplicate_of];
+        }
+    }
+    init_reloadable_coeffs(coeffs);
+    for (n = 0; n < bfconf->n_coeffs; n++) {
 	bfconf->coeffs[n] = coeffs[n]->coeff;
-	efree(coeffs[n]);
+        if (runtime_coeffs[n] == NULL) {
+            efree(coeffs[n]);
+        }
     }
+    efree(dests);
     if (bfconf->n_coeffs > 0) {
         pinfo("finished.\n");
     }
     efree(coeffs);
+    if (n_shared > 0) {
+        pinfo("%d identical coefficient sets shared, saving %.1f MB.\n",
+              n_shared, (double)shared_size / (1024.0 * 1024.0));
+    }
+    if (bfconf->n_lazy_slots > 0) {
+        pinfo("Lazily loaded coefficients: %d slots of %.1f MB.\n",
+              bfconf->n_lazy_slots,
+              (double)bfconf->lazy_slot_size / (1024.0 * 1024.0));
+    }
 
     /* shorten mute array */
     FOR_IN_AND_OUT {
@@ -2847,6 +3759,7 @@ bfconf_init(char filename[],
     }
     
     /* derive filter_process from filters */
+    filters = emalloc(bfconf->n_filters * sizeof(struct bffilter));
     bfconf->n_processes = largest_process + 1;
     bfconf->fproc = emalloc(bfconf->n_processes *
 			    sizeof(struct filter_process));
@@ -2961,6 +3874,7 @@ bfconf_init(char filename[],
 	memcpy(bfconf->fproc[n].filters, filters,
 	       bfconf->fproc[n].n_filters * sizeof(struct bffilter));
     }
+    efree(filters);
     
     /* load bflogic modules */
     if (bfconf->n_logicmods > 0) {
@@ -46,10 +46,31 @@ struct bfconf {
     bool_t monitor_rate;
     bool_t synched_write;
     bool_t allow_poll_mode;
+    bool_t pipelined;
+    bool_t hugepages;
+    bool_t cache_stagger;
+    char *coeff_cache;
+    size_t lazy_coeff_memory;
+    double meter_rate;
+    double delay_ramp;
+    int stagger_size;   /* padding between convolve buffers, zero if off */
+    int stagger_offset; /* start offset between buffer streams */
     struct dither_state **dither_state;
     int n_coeffs;
     struct bfcoeff *coeffs;
     void ***coeffs_data;
+    /* state of each coefficient set, NULL if there are no lazily loaded
+       coefficients, in which case all are ready */
+#define BF_COEFF_READY    0
+#define BF_COEFF_UNLOADED 1
+#define BF_COEFF_FAILED   2
+    volatile int *coeff_state;
+    int n_lazy_slots;
+    int lazy_slot_size;
+    uint8_t *lazy_slots;
+    /* spare block pointers for each coefficient set that can be reloaded at
+       runtime, NULL if none can */
+    void ***coeffs_spare;
     int n_channels[2];
     struct bfchannel *channels[2];
     int n_physical_channels[2];
@@ -76,6 +97,7 @@ struct bfconf {
     int *subdelay[2];
     int sdf_length;
     double sdf_beta;
+    bool_t freqd_subdelay;
     double safety_limit;
 };
 
@@ -86,4 +108,13 @@ bfconf_init(char filename[],
 	    bool_t quiet,
             bool_t nodefault);
 
+/* Load a lazily loaded or reloadable coefficient set into 'dest', which must
+   have room for its blocks spaced convolver_cbufsize() + stagger_size apart.
+   If 'filename' is NULL the configured file is read. Errors are printed and
+   cause exit. */
+void
+bfconf_load_coeff(int cindex,
+                  const char filename[],
+                  uint8_t *dest);
+
 #endif
@@ -22,6 +22,7 @@
 #define IS_BFIO_MODULE
 #include "bfmod.h"
 #include "bit.h"
+#include "textparse.h"
 
 #define TEXT_BUFFER_SIZE 4096
 #define OUTTEXT_FORMAT "%+.16e"
@@ -309,7 +310,8 @@ text_read(int fd,
           void *buf,
           int count)
 {
-    char *p, *p1, *parsebuf, *filebuf;
+    char *p, *parsebuf, *filebuf;
+    const char *p1;
     int retval, i, rest, size;
     struct readstate *rs;
     double *a;
@@ -393,7 +395,7 @@ text_read(int fd,
             /* skip empty lines */
             continue;
         }
-        a[i++] = strtod(parsebuf, &p1);
+        a[i++] = textparse_real(parsebuf, p, &p1);
         if (p1 == parsebuf) {
             fprintf(stderr, "File I/O: Read failed: bad text format.\n");
             errno = EIO;
@@ -38,6 +38,8 @@ static struct jack_state *handles[2][BF_MAXCHANNELS];
 static int expected_priority = -1;
 static void **states[2];
 static int n_handles[2];
+static void **port_bufs[2] = { NULL, NULL };
+static int n_port_bufs[2] = { 0, 0 };
 static bool_t hasio[2];
 static jack_client_t *client = NULL;
 static char *client_name = NULL;
@@ -134,18 +136,18 @@ process_callback(jack_nframes_t n_frames,
 {
     static int frames_left = 0;
     
-    void *in_bufs[BF_MAXCHANNELS], *out_bufs[BF_MAXCHANNELS], **iobufs[2];
     struct jack_state *js;
     void *buffer = NULL;
-    int n, i;
+    int n, i, k;
 
-    iobufs[IN] = n_handles[IN] > 0 ? in_bufs : NULL;
-    iobufs[OUT] = n_handles[OUT] > 0 ? out_bufs : NULL;
+    /* the buffer pointer arrays are allocated in bfio_init(), so that
+       nothing large is placed on the stack of the realtime thread */
     FOR_IN_AND_OUT {
-        for (n = 0; n < n_handles[IO]; n++) {
+        for (n = k = 0; n < n_handles[IO]; n++) {
             js = handles[IO][n];
             for (i = 0; i < js->n_channels; i++) {
-                iobufs[IO][i] = jack_port_get_buffer(js->ports[i], n_frames);
+                port_bufs[IO][k++] = jack_port_get_buffer(js->ports[i],
+                                                          n_frames);
             }
         }
     }
@@ -162,7 +164,7 @@ process_callback(jack_nframes_t n_frames,
         stopped = true;
         return -1;
     }
-    frames_left = process_cb(states, n_handles, iobufs, n_frames,
+    frames_left = process_cb(states, n_handles, port_bufs, n_frames,
                              BF_CALLBACK_EVENT_NORMAL);
     if (frames_left == -1) {
         stopped = true;
@@ -484,6 +486,9 @@ bfio_init(void *params,
         js->port_name[n] = estrdup(longname);
     }
 
+    n_port_bufs[io] += used_channels;
+    port_bufs[io] = erealloc(port_bufs[io], n_port_bufs[io] * sizeof(void *));
+
     _states[io][n_handles[io]] = callback_state;
     handles[io][n_handles[io]++] = js;
 
@@ -15,6 +15,7 @@
 #include <sys/poll.h>
 #include <sys/un.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <math.h>
@@ -52,6 +53,8 @@ cfc  -- change filter coefficients.\n\
         cfc <filter> <coeff>\n\
 cfd  -- change filter delay. (may truncate coeffs!)\n\
         cfd <filter> <delay blocks>\n\
+rlc  -- reload coefficients, optionally from another file.\n\
+        rlc <coeff> [\"<filename>\"]\n\
 cod  -- change output delay.\n\
         cod <output> <delay> [<subdelay>]\n\
 cid  -- change input delay.\n\
@@ -66,6 +69,9 @@ omc  -- issue output module command.\n\
         omc <index> <command>\n\
 lmc  -- issue logic module command.\n\
         lmc <module> <command>\n\
+at   -- make the filter changes later on the line at the start of a block,\n\
+        given as index, relative to the current, or as a sample.\n\
+        at <block|+blocks|s<sample>>\n\
 \n\
 sleep -- sleep for the given number of seconds [and ms], or blocks.\n\
          sleep 10 (sleep 10 seconds).\n\
@@ -91,6 +97,13 @@ Notes:\n\
 
 #define MAXCMDLINE 4096
 
+/* control endpoint: <uint32: length><uint32: id><commands> in, and
+   <uint32: length><uint32: id><output> out, integers in network byte order,
+   length counting what follows it */
+#define MAX_CONTROL_CLIENTS 32
+#define MAX_CONTROL_MSG 65536
+#define MAX_CONTROL_QUEUE (1024 * 1024)
+
 #define FILTER_ID 1
 #define INPUT_ID  2
 #define OUTPUT_ID 3
@@ -106,6 +119,8 @@ static const struct bfchannel **channels;
 static int line_speed;
 static int port, port2;
 static char *lport = NULL;
+static int control_port;
+static char *control_lport = NULL;
 static char *script = NULL;
 static struct bfaccess *bfaccess;
 static int n_maxblocks;
@@ -131,10 +146,31 @@ struct state {
     int delay[2][BF_MAXCHANNELS];
     int subdelay[2][BF_MAXCHANNELS];
     bool_t toggle_mute[2][BF_MAXCHANNELS];
+    bool_t at;
+    unsigned int at_block;
 };
 
 static struct state newstate;
 
+struct control_client {
+    int fd;
+    uint8_t *inbuf;
+    int inlen;
+    uint8_t *outbuf;
+    int outlen;
+    int outsize;
+    bool_t closing;
+};
+
+static int control_lsock = -1;
+static int n_control_clients = 0;
+static struct control_client control_clients[MAX_CONTROL_CLIENTS];
+
+/* The text client is read without blocking, so a partial line does not hold
+   up the control clients. Input is gathered here until a line is complete. */
+static char text_inbuf[MAXCMDLINE];
+static int text_inlen = 0;
+
 static void
 clear_changes(void)
 {
@@ -158,6 +194,7 @@ clear_changes(void)
     }
     memset(newstate.toggle_mute, 0, sizeof(newstate.toggle_mute));
     memset(newstate.fchanged, 0, sizeof(newstate.fchanged));
+    newstate.at = false;
     memset(newstate.delay, -1, sizeof(newstate.delay));
     for (n = 0; n < BF_MAXCHANNELS; n++) {
         newstate.subdelay[IN][n] = BF_UNDEFINED_SUBDELAY;
@@ -165,11 +202,47 @@ clear_changes(void)
     }
 }
 
+/* Channel delay and mute are changed in the I/O processes, so only filter
+   changes can be made at an exact block. */
+static void
+commit_scheduled_changes(FILE *stream)
+{
+    int n;
+
+    FOR_IN_AND_OUT {
+        for (n = 0; n < n_channels[IO]; n++) {
+            if (newstate.delay[IO][n] != -1 ||
+                newstate.subdelay[IO][n] != BF_UNDEFINED_SUBDELAY ||
+                newstate.toggle_mute[IO][n])
+            {
+                fprintf(stream, "Only filter changes can be scheduled, "
+                        "channel changes ignored.\n");
+                break;
+            }
+        }
+    }
+    for (n = 0; n < n_filters; n++) {
+        if (!newstate.fchanged[n]) {
+            continue;
+        }
+        if (bfaccess->schedule_filter(newstate.at_block, n,
+                                      &newstate.fctrl[n]) == -1)
+        {
+            fprintf(stream, "Could not schedule change of filter %d at block "
+                    "%u.\n", n, newstate.at_block);
+        }
+    }
+}
+
 static void
 commit_changes(FILE *stream)
 {
     int n, i;
     
+    if (newstate.at) {
+        commit_scheduled_changes(stream);
+        return;
+    }
     FOR_IN_AND_OUT {
         for (n = 0; n < n_channels[IO]; n++) {
             if (newstate.delay[IO][n] != -1) {
@@ -416,7 +489,7 @@ parse_command(FILE *stream,
     int n, i, rid, id, range[2];
     const char **names;
     double att;
-    char *p;
+    char *p, *end, at_type;
 
     if (strcmp(cmd, "lf") == 0) {
 	fprintf(stream, "Filters:\n");
@@ -664,6 +737,27 @@ parse_command(FILE *stream,
                 newstate.fchanged[rid] = true;
 	    }
 	}
+    } else if (strstr(cmd, "rlc") == cmd) {
+        end = cmd + strlen(cmd);
+	if (get_id(stream, cmd + 3, &cmd, &id, COEFF_ID, -1)) {
+            /* get_id steps past the terminator if there is no filename */
+            cmd = strtrim(cmd > end ? end : cmd);
+            p = NULL;
+            if (cmd[0] == '\"') {
+                p = cmd + 1;
+                if ((cmd = strchr(p, '\"')) == NULL) {
+                    fprintf(stream, "Invalid string.\n");
+                    return true;
+                }
+                *cmd = '\0';
+            } else if (cmd[0] != '\0') {
+                p = cmd;
+            }
+            if (id < 0 || bfaccess->reload_coeff(id, p) == -1) {
+                fprintf(stream, "Coefficient set %d is not reloadable, or "
+                        "is being reloaded.\n", id);
+            }
+	}
     } else if (strstr(cmd, "tmo") == cmd) {
 	if (get_id(stream, cmd + 3, &cmd, &id, OUTPUT_ID, -1)) {
             newstate.toggle_mute[OUT][id] = !newstate.toggle_mute[OUT][id];
@@ -758,6 +852,38 @@ parse_command(FILE *stream,
                 memcpy(_sleep_task, &sleep_task, sizeof(struct sleep_task));
             }
         }
+    } else if (strncmp(cmd, "at", 2) == 0 &&
+               (cmd[2] == ' ' || cmd[2] == '\t' || cmd[2] == '\0'))
+    {
+        /* only the commands after this one are scheduled, so the changes
+           made so far on the line are committed as they are */
+        if (are_changes()) {
+            bfaccess->control_mutex(1);
+            commit_changes(stream);
+            bfaccess->control_mutex(0);
+            clear_changes();
+        }
+        p = strtrim(cmd + 2);
+        at_type = *p;
+        if (at_type == '+' || at_type == 's') {
+            p++;
+        }
+        if (at_type == '+') {
+            n = strtol(p, &end, 10);
+            newstate.at_block = bfaccess->current_block() + n;
+        } else if (at_type == 's') {
+            /* rounded up to the next block boundary */
+            newstate.at_block = (unsigned int)
+                ((strtoull(p, &end, 10) + block_length - 1) / block_length);
+        } else {
+            newstate.at_block = strtoul(p, &end, 10);
+        }
+        if (end == p || *end != '\0') {
+            fprintf(stream, "Invalid block.\n");
+        } else {
+            newstate.at = true;
+            fprintf(stream, "Scheduling at block %u.\n", newstate.at_block);
+        }
     } else if (strstr(cmd, "abort") == cmd) {
 	bfaccess->exit(BF_EXIT_OK);
     } else if (strcmp(cmd, "help") == 0) {
@@ -770,30 +896,270 @@ parse_command(FILE *stream,
 }
 
 static void
+control_close(int index)
+{
+    close(control_clients[index].fd);
+    free(control_clients[index].inbuf);
+    free(control_clients[index].outbuf);
+    n_control_clients--;
+    if (index != n_control_clients) {
+        control_clients[index] = control_clients[n_control_clients];
+    }
+}
+
+static void
+control_accept(void)
+{
+    struct control_client *client;
+    int sock;
+
+    if ((sock = accept(control_lsock, NULL, NULL)) == -1) {
+        if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+            fprintf(stderr, "CLI: Accept failed: %s.\n", strerror(errno));
+        }
+        return;
+    }
+    if (n_control_clients == MAX_CONTROL_CLIENTS) {
+        fprintf(stderr, "CLI: Too many control clients, closing new "
+                "connection.\n");
+        close(sock);
+        return;
+    }
+    if (fcntl(sock, F_SETFL, O_NONBLOCK) == -1) {
+        fprintf(stderr, "CLI: fcntl failed: %s.\n", strerror(errno));
+        close(sock);
+        return;
+    }
+    client = &control_clients[n_control_clients];
+    memset(client, 0, sizeof(struct control_client));
+    client->fd = sock;
+    if ((client->inbuf = malloc(MAX_CONTROL_MSG + 4)) == NULL) {
+        fprintf(stderr, "CLI: Memory allocation failure.\n");
+        bfaccess->exit(BF_EXIT_OTHER);
+    }
+    n_control_clients++;
+}
+
+static void
+control_queue_reply(struct control_client *client,
+                    uint32_t id,
+                    const char text[],
+                    int len)
+{
+    uint32_t header[2];
+
+    if (client->outlen + len + 8 > MAX_CONTROL_QUEUE) {
+        fprintf(stderr, "CLI: Control client does not read its replies, "
+                "closing connection.\n");
+        client->closing = true;
+        client->outlen = 0;
+        return;
+    }
+    if (client->outlen + len + 8 > client->outsize) {
+        client->outsize = 2 * (client->outlen + len + 8);
+        if ((client->outbuf = realloc(client->outbuf, client->outsize))
+            == NULL)
+        {
+            fprintf(stderr, "CLI: Memory allocation failure.\n");
+            bfaccess->exit(BF_EXIT_OTHER);
+        }
+    }
+    header[0] = htonl(len + 4);
+    header[1] = htonl(id);
+    memcpy(&client->outbuf[client->outlen], header, 8);
+    memcpy(&client->outbuf[client->outlen + 8], text, len);
+    client->outlen += len + 8;
+}
+
+/* All commands in a message are parsed first, and the changes are then
+   committed in a single pass, just like a line with several commands in
+   the text interface. */
+static bool_t
+parse_batch(FILE *stream,
+            char cmds[])
+{
+    char *p, *s, *s1;
+    bool_t do_quit;
+
+    do_quit = false;
+    clear_changes();
+    s = cmds;
+    do {
+        if ((p = strpbrk(s, ";\n")) != NULL) {
+            *p = '\0';
+        }
+        s1 = strtrim(s);
+        if (strstr(s1, "sleep") == s1) {
+            fprintf(stream, "Sleep is not allowed on the control port.\n");
+        } else if (*s1 != '\0' && !parse_command(stream, s1, NULL)) {
+            do_quit = true;
+        }
+        s = p + 1;
+    } while (p != NULL);
+    if (are_changes()) {
+        bfaccess->control_mutex(1);
+        commit_changes(stream);
+        bfaccess->control_mutex(0);
+    }
+    return !do_quit;
+}
+
+static void
+control_process(struct control_client *client)
+{
+    static char cmds[MAX_CONTROL_MSG + 1];
+    uint32_t len, id;
+    char *reply;
+    size_t reply_size;
+    FILE *stream;
+    int n;
+
+    while (client->inlen >= 4) {
+        memcpy(&len, client->inbuf, 4);
+        len = ntohl(len);
+        if (len < 4 || len > MAX_CONTROL_MSG) {
+            fprintf(stderr, "CLI: Invalid control message length %u, closing "
+                    "connection.\n", (unsigned int)len);
+            client->closing = true;
+            client->outlen = 0;
+            return;
+        }
+        if (client->inlen < (int)len + 4) {
+            return;
+        }
+        memcpy(&id, &client->inbuf[4], 4);
+        id = ntohl(id);
+        for (n = 0; n < (int)len - 4; n++) {
+            cmds[n] = (char)client->inbuf[8 + n];
+            if (cmds[n] == '\0' || cmds[n] == '\r' || cmds[n] == '\t') {
+                cmds[n] = ' ';
+            }
+        }
+        cmds[n] = '\0';
+        reply = NULL;
+        reply_size = 0;
+        if ((stream = open_memstream(&reply, &reply_size)) == NULL) {
+            fprintf(stderr, "CLI: open_memstream failed: %s.\n",
+                    strerror(errno));
+            bfaccess->exit(BF_EXIT_OTHER);
+        }
+        if (!parse_batch(stream, cmds)) {
+            client->closing = true;
+        }
+        fclose(stream);
+        control_queue_reply(client, id, reply, (int)reply_size);
+        free(reply);
+        client->inlen -= len + 4;
+        memmove(client->inbuf, &client->inbuf[len + 4], client->inlen);
+        if (client->closing) {
+            return;
+        }
+    }
+}
+
+/* returns false if the client should be closed */
+static bool_t
+control_read(struct control_client *client)
+{
+    int n;
+
+    n = read(client->fd, &client->inbuf[client->inlen],
+             MAX_CONTROL_MSG + 4 - client->inlen);
+    if (n == 0) {
+        return false;
+    }
+    if (n == -1) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    client->inlen += n;
+    control_process(client);
+    return true;
+}
+
+static bool_t
+control_write(struct control_client *client)
+{
+    int n;
+
+    if ((n = write(client->fd, client->outbuf, client->outlen)) == -1) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    client->outlen -= n;
+    memmove(client->outbuf, &client->outbuf[n], client->outlen);
+    return true;
+}
+
+/* Move a complete line from the text client buffer to 'line', as fgets()
+   would have returned it. A line longer than the buffer is split. */
+static bool_t
+text_get_line(char line[MAXCMDLINE])
+{
+    char *p;
+    int len;
+
+    if ((p = memchr(text_inbuf, '\n', text_inlen)) != NULL) {
+        len = p - text_inbuf + 1;
+    } else if (text_inlen == MAXCMDLINE - 2) {
+        len = text_inlen;
+    } else {
+        return false;
+    }
+    memcpy(line, text_inbuf, len);
+    line[len] = '\0';
+    text_inlen -= len;
+    memmove(text_inbuf, &text_inbuf[len], text_inlen);
+    return true;
+}
+
+/* Wait for the text client, serving the control clients and callback events
+   meanwhile. If 'line' is NULL, it returns when 'client_fd' is readable, else
+   when a complete line has been read from it. Returns false if the text
+   client has closed the connection. */
+static bool_t
 wait_data(FILE *client_stream,
 	  int client_fd,
-	  int callback_fd)
+	  int callback_fd,
+          char line[MAXCMDLINE])
 {
-    fd_set rfds;
+    struct pollfd fds[3 + MAX_CONTROL_CLIENTS];
+    int n, i, n_fds, client_index;
+    bool_t client_ready;
     uint32_t msg;
-    int n;
 
-    FD_ZERO(&rfds);
-    
+    if (line != NULL && text_get_line(line)) {
+        return true;
+    }
     do {
-	FD_SET(client_fd, &rfds);
-	FD_SET(callback_fd, &rfds);
 	if (client_stream != NULL) {
 	    fflush(client_stream);
 	}
-	while ((n = select(client_fd < callback_fd ? callback_fd + 1 :
-			   client_fd + 1, &rfds, NULL, NULL, NULL)) == -1
-	       && errno == EINTR);
+        n_fds = 0;
+        fds[n_fds].fd = callback_fd;
+        fds[n_fds++].events = POLLIN;
+        client_index = -1;
+        if (client_fd != -1) {
+            client_index = n_fds;
+            fds[n_fds].fd = client_fd;
+            fds[n_fds++].events = POLLIN;
+        }
+        if (control_lsock != -1) {
+            fds[n_fds].fd = control_lsock;
+            fds[n_fds++].events = POLLIN;
+        }
+        for (n = 0; n < n_control_clients; n++) {
+            fds[n_fds].fd = control_clients[n].fd;
+            fds[n_fds].events = control_clients[n].closing ? 0 : POLLIN;
+            if (control_clients[n].outlen > 0) {
+                fds[n_fds].events |= POLLOUT;
+            }
+            n_fds++;
+        }
+	while ((n = poll(fds, n_fds, -1)) == -1 && errno == EINTR);
 	if (n == -1) {
-	    fprintf(stderr, "CLI: Select failed: %s.\n", strerror(errno));
+	    fprintf(stderr, "CLI: Poll failed: %s.\n", strerror(errno));
 	    bfaccess->exit(BF_EXIT_OTHER);
 	}
-	if (FD_ISSET(callback_fd, &rfds)) {
+	if (fds[0].revents != 0) {
 	    if (!readfd(callback_fd, &msg, 4)) {
                 bfaccess->exit(BF_EXIT_OK);
             }
@@ -809,7 +1175,48 @@ wait_data(FILE *client_stream,
 		break;
 	    }
 	}
-    } while (!FD_ISSET(client_fd, &rfds));
+        client_ready = client_index != -1 && fds[client_index].revents != 0;
+        if (client_ready && line != NULL) {
+            n = read(client_fd, &text_inbuf[text_inlen],
+                     MAXCMDLINE - 2 - text_inlen);
+            if (n == 0 || (n == -1 && errno != EINTR && errno != EAGAIN)) {
+                text_inlen = 0;
+                return false;
+            }
+            if (n > 0) {
+                text_inlen += n;
+            }
+            client_ready = text_get_line(line);
+        }
+        i = n_fds - n_control_clients;
+        if (control_lsock != -1 && fds[i - 1].revents != 0) {
+            control_accept();
+        }
+        /* backwards, since closing moves the last client */
+        for (n = n_fds - 1; n >= i; n--) {
+            if ((fds[n].revents & POLLIN) != 0 &&
+                !control_read(&control_clients[n - i]))
+            {
+                control_close(n - i);
+                continue;
+            }
+            if ((fds[n].revents & POLLOUT) != 0 &&
+                !control_write(&control_clients[n - i]))
+            {
+                control_close(n - i);
+                continue;
+            }
+            if ((fds[n].revents & (POLLERR | POLLNVAL)) != 0 ||
+                ((fds[n].revents & POLLHUP) != 0 &&
+                 (fds[n].revents & POLLIN) == 0) ||
+                (control_clients[n - i].closing &&
+                 control_clients[n - i].outlen == 0))
+            {
+                control_close(n - i);
+            }
+        }
+    } while (!client_ready);
+    return true;
 }
 
 static bool_t
@@ -1025,16 +1432,13 @@ parse_string(FILE *stream,
 static void
 stream_loop(int event_fd,
             int infd,
-            FILE *instream,
             FILE *outstream)
 {
     char inbuf[MAXCMDLINE], cmd[MAXCMDLINE];
     
-    inbuf[MAXCMDLINE - 1] = '\0';	
     while (true) {
-        wait_data(outstream, infd, event_fd);
-        if (fgets(inbuf, MAXCMDLINE - 1, instream) == NULL) {
-            fprintf(stderr, "CLI: fgets failed: %s.\n", strerror(errno));
+        if (!wait_data(outstream, infd, event_fd, inbuf)) {
+            fprintf(stderr, "CLI: Input closed or read failed.\n");
             bfaccess->exit(BF_EXIT_OTHER);
         }
         parse_string(outstream, inbuf, cmd);
@@ -1051,7 +1455,7 @@ socket_loop(int event_fd,
     int sock;
     
     while (true) {
-	wait_data(NULL, lsock, event_fd);
+	wait_data(NULL, lsock, event_fd, NULL);
 	if ((sock = accept(lsock, NULL, NULL)) == -1) {
 	    fprintf(stderr, "CLI: Accept failed: %s.\n", strerror(errno));
 	    bfaccess->exit(BF_EXIT_OTHER);
@@ -1065,9 +1469,7 @@ socket_loop(int event_fd,
 	fprintf(stream, WELCOME_TEXT);
 	fprintf(stream, PROMPT_TEXT);
 	
-	wait_data(stream, sock, event_fd);
-	cmd[MAXCMDLINE - 1] = '\0';	
-	while (fgets(inbuf, MAXCMDLINE - 1, stream) != NULL) {
+	while (wait_data(stream, sock, event_fd, inbuf)) {
             parse_string(stream, inbuf, cmd);
 	    if (!parse(stream, cmd, NULL)) {
 		break;
@@ -1075,9 +1477,9 @@ socket_loop(int event_fd,
 	    if (print_prompt) {
 		fprintf(stream, PROMPT_TEXT);
 	    }
-	    wait_data(stream, sock, event_fd);
 	}
 	print_peak_updates = false;
+        text_inlen = 0;
 	fclose(stream);
     }
 }
@@ -1100,7 +1502,7 @@ bflogic_preinit(int *version_major,
                 int _debug)
 {
     union bflexval lexval;
-    int token, ver;
+    int token, ver, n;
 
     ver = *version_major;
     *version_major = BF_VERSION_MAJOR;
@@ -1113,6 +1515,8 @@ bflogic_preinit(int *version_major,
     port = -1;
     port2 = -1;
     lport = NULL;
+    control_port = -1;
+    control_lport = NULL;
     script = NULL;
     line_speed = 9600;
     debug = !!_debug;
@@ -1151,6 +1555,19 @@ bflogic_preinit(int *version_major,
                         "integer.\n");
                 return -1;
             }
+        } else if (strcmp(lexval.field, "control_port") == 0) {
+            switch (get_config_token(&lexval)) {
+            case BF_LEXVAL_STRING:
+                control_lport = strdup(lexval.string);
+                break;
+            case BF_LEXVAL_REAL:
+                control_port = (int)lexval.real;
+                break;
+            default:
+                fprintf(stderr, "CLI: Parse error: expected string or "
+                        "integer.\n");
+                return -1;
+            }
         } else if (strcmp(lexval.field, "script") == 0) {
             if (get_config_token(&lexval) != BF_LEXVAL_STRING) {
                 fprintf(stderr, "CLI: Parse error: expected string.\n");
@@ -1190,15 +1607,34 @@ bflogic_preinit(int *version_major,
     n_filters = _n_filters;
     filters = _filters;
 
+    for (n = 0; n < n_filters; n++) {
+        newstate.fctrl[n].scale[IN] =
+            malloc((filters[n].n_channels[IN] + filters[n].n_channels[OUT] +
+                    filters[n].n_filters[IN] + 1) * sizeof(double));
+        if (newstate.fctrl[n].scale[IN] == NULL) {
+            fprintf(stderr, "CLI: Memory allocation failure.\n");
+            return -1;
+        }
+        newstate.fctrl[n].scale[OUT] =
+            &newstate.fctrl[n].scale[IN][filters[n].n_channels[IN]];
+        newstate.fctrl[n].fscale =
+            &newstate.fctrl[n].scale[OUT][filters[n].n_channels[OUT]];
+    }
+
     if (script == NULL) {
-        if (port == -1 && lport == NULL) {
-            fprintf(stderr, "CLI: \"port\" or \"script\" must be set.\n");
+        if (port == -1 && lport == NULL &&
+            control_port == -1 && control_lport == NULL)
+        {
+            fprintf(stderr, "CLI: \"port\", \"control_port\" or "
+                    "\"script\" must be set.\n");
             return -1;
         }    
         bfevents->fdevents = BF_FDEVENT_PEAK;
         *fork_mode = BF_FORK_PRIO_MAX;
     } else {
-        if (port != -1 || lport != NULL) {
+        if (port != -1 || lport != NULL ||
+            control_port != -1 || control_lport != NULL)
+        {
             fprintf(stderr, "CLI: Cannot have both \"script\" and \"port\" "
                     "set.\n");
             return -1;
@@ -1209,6 +1645,81 @@ bflogic_preinit(int *version_major,
     return 0;
 }
 
+static int
+listen_socket(int tcp_port,
+              const char path[],
+              int backlog)
+{
+    struct sockaddr_in s_in;
+    struct sockaddr_un s_un;
+    int lsock, opt;
+
+    if (path == NULL) {
+	memset(&s_in, 0, sizeof(s_in));
+	s_in.sin_family = AF_INET;
+	s_in.sin_addr.s_addr = INADDR_ANY;
+	s_in.sin_port = htons(tcp_port);
+
+	if ((lsock = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
+	    fprintf(stderr, "CLI: Failed to create socket: %s.\n",
+                    strerror(errno));
+	    bfaccess->exit(BF_EXIT_OTHER);
+	}
+        opt = 1;
+	if (setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))
+	    == -1)
+	{
+	    fprintf(stderr, "CLI: Failed to set socket options: %s.\n",
+		    strerror(errno));
+	    bfaccess->exit(BF_EXIT_OTHER);
+	}    
+	if (bind(lsock, (struct sockaddr *)&s_in, sizeof(struct sockaddr_in))
+	    == -1)
+	{
+	    fprintf(stderr, "CLI: Failed to bind name to socket: %s.\n",
+		    strerror(errno));
+	    bfaccess->exit(BF_EXIT_OTHER);
+	}
+	if (listen(lsock, backlog) != 0) {
+	    fprintf(stderr, "CLI: Failed to listen on port %d: %s.\n",
+		    tcp_port, strerror(errno));
+	    bfaccess->exit(BF_EXIT_OTHER);
+	}
+        return lsock;
+    }
+    
+    remove(path);
+    memset(&s_un, 0, sizeof(s_un));
+    s_un.sun_family = AF_UNIX;
+    strncpy(s_un.sun_path, path, sizeof(s_un.sun_path));
+    s_un.sun_path[sizeof(s_un.sun_path) - 1] = '\0';
+
+    if ((lsock = socket(PF_UNIX, SOCK_STREAM, 0)) == -1) {
+        fprintf(stderr, "CLI: Failed to create socket: %s.\n",
+                strerror(errno));
+        bfaccess->exit(BF_EXIT_OTHER);
+    }
+
+    if (bind(lsock, (struct sockaddr *)&s_un, sizeof(struct sockaddr_un))
+        == -1)
+    {
+        if (errno == EADDRINUSE) {
+            fprintf(stderr, "CLI: Failed to create local socket: "
+                    "path \"%s\" already exists.\n", s_un.sun_path);
+        } else {
+            fprintf(stderr, "CLI: Failed to bind name to socket: %s.\n",
+                    strerror(errno));
+        }
+        bfaccess->exit(BF_EXIT_OTHER);
+    }
+    if (listen(lsock, backlog) != 0) {
+        fprintf(stderr, "CLI: Failed to listen on local "
+                "socket \"%s\": %s.\n", s_un.sun_path, strerror(errno));
+        bfaccess->exit(BF_EXIT_OTHER);
+    }
+    return lsock;
+}
+
 #define WRITE_TO_SYNCH_FD                                                      \
     dummy = 0;                                                                 \
     if (!writefd(synch_fd, &dummy, 1)) {                                       \
@@ -1230,10 +1741,8 @@ bflogic_init(struct bfaccess *_bfaccess,
 	     int event_fd,
              int synch_fd)
 {
-    FILE *stream, *instream, *outstream;
-    int lsock, fd, speed, opt;
-    struct sockaddr_in s_in;
-    struct sockaddr_un s_un;
+    FILE *stream, *outstream;
+    int lsock, fd, speed;
     struct termios newtio;
     uint8_t dummy;
 
@@ -1244,6 +1753,16 @@ bflogic_init(struct bfaccess *_bfaccess,
         return 0;
     }
 
+    if (control_port != -1 || control_lport != NULL) {
+        control_lsock = listen_socket(control_port, control_lport,
+                                      MAX_CONTROL_CLIENTS);
+        if (fcntl(control_lsock, F_SETFL, O_NONBLOCK) == -1) {
+            fprintf(stderr, "CLI: fcntl failed: %s.\n", strerror(errno));
+            bfaccess->exit(BF_EXIT_OTHER);
+        }
+        free(control_lport);
+    }
+
     if (lport != NULL && strstr(lport, "/dev/") == lport) {
         /* serial line interface */
         if ((fd = open(lport, O_RDWR | O_NOCTTY)) == -1) {
@@ -1301,16 +1820,10 @@ bflogic_init(struct bfaccess *_bfaccess,
         setvbuf(stream, NULL, _IOLBF, 0);
         WRITE_TO_SYNCH_FD;
         
-        stream_loop(event_fd, fd, stream, stream);
+        stream_loop(event_fd, fd, stream);
         
     } else if (port != -1 && port2 != -1) {
-        /* pipe interface */
-	if ((instream = fdopen(port, "r")) == NULL) {
-	    fprintf(stderr, "CLI: fdopen 'r' on fd %d failed: %s.\n",
-                    port, strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}
-	setvbuf(instream, NULL, _IOLBF, 0);
+        /* pipe interface, input is read directly from the descriptor */
 	if ((outstream = fdopen(port2, "w")) == NULL) {
 	    fprintf(stderr, "CLI: fdopen 'w' on fd %d failed: %s.\n",
                     port2, strerror(errno));
@@ -1319,80 +1832,31 @@ bflogic_init(struct bfaccess *_bfaccess,
 	setvbuf(outstream, NULL, _IOLBF, 0);
         WRITE_TO_SYNCH_FD;
 
-        stream_loop(event_fd, port, instream, outstream);
+        stream_loop(event_fd, port, outstream);
 
     } else if (port != -1) {
         /* TCP interface */
-	memset(&s_in, 0, sizeof(s_in));
-	s_in.sin_family = AF_INET;
-	s_in.sin_addr.s_addr = INADDR_ANY;
-	s_in.sin_port = htons(port);
-
-	if ((lsock = socket(PF_INET, SOCK_STREAM, 0)) == -1) {
-	    fprintf(stderr, "CLI: Failed to create socket: %s.\n",
-                    strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}
-        opt = 1;
-	if (setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))
-	    == -1)
-	{
-	    fprintf(stderr, "CLI: Failed to set socket options: %s.\n",
-		    strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}    
-	if (bind(lsock, (struct sockaddr *)&s_in, sizeof(struct sockaddr_in))
-	    == -1)
-	{
-	    fprintf(stderr, "CLI: Failed to bind name to socket: %s.\n",
-		    strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}
-	if (listen(lsock, 1) != 0) {
-	    fprintf(stderr, "CLI: Failed to listen on port %d: %s.\n",
-		    port, strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}
+        lsock = listen_socket(port, NULL, 1);
         WRITE_TO_SYNCH_FD;
         
         socket_loop(event_fd, lsock);
         
     } else if (lport != NULL) {
         /* local socket interface */
-        remove(lport);
-	memset(&s_un, 0, sizeof(s_un));
-	s_un.sun_family = AF_UNIX;
-	strncpy(s_un.sun_path, lport, sizeof(s_un.sun_path));
-	s_un.sun_path[sizeof(s_un.sun_path) - 1] = '\0';
-
-	if ((lsock = socket(PF_UNIX, SOCK_STREAM, 0)) == -1) {
-	    fprintf(stderr, "CLI: Failed to create socket: %s.\n",
-                    strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}
-
-	if (bind(lsock, (struct sockaddr *)&s_un, sizeof(struct sockaddr_un))
-	    == -1)
-	{
-            if (errno == EADDRINUSE) {
-                fprintf(stderr, "CLI: Failed to create local socket: "
-                        "path \"%s\" already exists.\n", s_un.sun_path);
-            } else {
-                fprintf(stderr, "CLI: Failed to bind name to socket: %s.\n",
-                        strerror(errno));
-            }
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}
-	if (listen(lsock, 1) != 0) {
-	    fprintf(stderr, "CLI: Failed to listen on local "
-                    "socket \"%s\": %s.\n", s_un.sun_path, strerror(errno));
-	    bfaccess->exit(BF_EXIT_OTHER);
-	}	
+        lsock = listen_socket(-1, lport, 1);
 	free(lport);
         WRITE_TO_SYNCH_FD;
         
         socket_loop(event_fd, lsock);
         
+    } else if (control_lsock != -1) {
+        /* control port only */
+        WRITE_TO_SYNCH_FD;
+
+        while (true) {
+            wait_data(NULL, -1, event_fd, NULL);
+        }
+        
     } else {
         fprintf(stderr, "CLI: No port specified.\n");
         bfaccess->exit(BF_EXIT_OTHER);
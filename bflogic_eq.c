@@ -13,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/select.h>
+#include <fcntl.h>
 
 #include <fftw3.h>
 
@@ -28,19 +29,49 @@
 
 #define MAX_EQUALISERS 64
 #define MAX_BANDS 128
-#define MSGSIZE (MAX_BANDS * 20)
+#define MAX_SLOTS 8
+#define MAX_PBANDS 32
+#define MSGSIZE (MAX_BANDS * 20 + MAX_PBANDS * 40)
 
 #define CMD_CHANGE_MAGNITUDE 1
 #define CMD_CHANGE_PHASE 2
 #define CMD_GET_INFO 3
+#define CMD_CHANGE_PARAMETRIC 4
+
+#define PBAND_PEAK 0
+#define PBAND_LOWSHELF 1
+#define PBAND_HIGHSHELF 2
+#define PBAND_LOWPASS 3
+#define PBAND_HIGHPASS 4
+
+static const char *pband_names[] = {
+    "peak", "lowshelf", "highshelf", "lowpass", "highpass", NULL
+};
+
+struct parametric_band {
+    int type;
+    double freq;
+    double q;
+    double gain;
+    /* squared magnitude of numerator and denominator as polynomials in
+       cos(w), lowest order first */
+    double num[3];
+    double den[3];
+};
 
 struct realtime_eq {
     void *ifftplan;
+    void *fftplan;
+    bool_t minimum_phase;
     int band_count;
     int taps;
-    volatile int coeff[2];
-    volatile int active_coeff;
-    volatile bool_t not_changed;
+    int coeff[MAX_SLOTS];
+    int n_slots;
+    volatile int active_slot;
+    volatile int picked_up_slot;
+    volatile bool_t waiting;
+    int n_pbands;
+    struct parametric_band pbands[MAX_PBANDS];
     double *freq;
     double *mag;
     double *phase;
@@ -59,25 +90,142 @@ static int n_filters;
 static const struct bfcoeff *coeffs;
 static char *debug_dump_filter_path = NULL;
 static int cmdpipe[2], cmdpipe_reply[2];
+static int notify_pipe[2];
 static bool_t debug = false;
 static void *rbuf;
+static double *pbuf;
+
+/* Set up the biquad of a parametric band (as given by the RBJ audio EQ
+   cookbook), and convert it to polynomials in cos(w), that is
+   |b0 + b1 z^-1 + b2 z^-2|^2 = b0^2 + b1^2 + b2^2 - 2 b0 b2 +
+   2 (b0 b1 + b1 b2) cos(w) + 4 b0 b2 cos(w)^2 for z = e^jw, so that the
+   response can be evaluated without trigonometric functions per bin. */
+static void
+parametric_band_setup(struct parametric_band *pb)
+{
+    double w0, cosw0, alpha, A, sqA, b[3], a[3];
+    int n;
+
+    w0 = 2.0 * M_PI * pb->freq / (double)sample_rate;
+    cosw0 = cos(w0);
+    alpha = sin(w0) / (2.0 * pb->q);
+    A = pow(10, pb->gain / 40);
+    sqA = 2.0 * sqrt(A) * alpha;
+    switch (pb->type) {
+    case PBAND_PEAK:
+        b[0] = 1.0 + alpha * A;
+        b[1] = -2.0 * cosw0;
+        b[2] = 1.0 - alpha * A;
+        a[0] = 1.0 + alpha / A;
+        a[1] = -2.0 * cosw0;
+        a[2] = 1.0 - alpha / A;
+        break;
+    case PBAND_LOWSHELF:
+        b[0] = A * ((A + 1.0) - (A - 1.0) * cosw0 + sqA);
+        b[1] = 2.0 * A * ((A - 1.0) - (A + 1.0) * cosw0);
+        b[2] = A * ((A + 1.0) - (A - 1.0) * cosw0 - sqA);
+        a[0] = (A + 1.0) + (A - 1.0) * cosw0 + sqA;
+        a[1] = -2.0 * ((A - 1.0) + (A + 1.0) * cosw0);
+        a[2] = (A + 1.0) + (A - 1.0) * cosw0 - sqA;
+        break;
+    case PBAND_HIGHSHELF:
+        b[0] = A * ((A + 1.0) + (A - 1.0) * cosw0 + sqA);
+        b[1] = -2.0 * A * ((A - 1.0) + (A + 1.0) * cosw0);
+        b[2] = A * ((A + 1.0) + (A - 1.0) * cosw0 - sqA);
+        a[0] = (A + 1.0) - (A - 1.0) * cosw0 + sqA;
+        a[1] = 2.0 * ((A - 1.0) - (A + 1.0) * cosw0);
+        a[2] = (A + 1.0) - (A - 1.0) * cosw0 - sqA;
+        break;
+    case PBAND_LOWPASS:
+        b[0] = (1.0 - cosw0) / 2.0;
+        b[1] = 1.0 - cosw0;
+        b[2] = (1.0 - cosw0) / 2.0;
+        a[0] = 1.0 + alpha;
+        a[1] = -2.0 * cosw0;
+        a[2] = 1.0 - alpha;
+        break;
+    case PBAND_HIGHPASS:
+    default:
+        b[0] = (1.0 + cosw0) / 2.0;
+        b[1] = -(1.0 + cosw0);
+        b[2] = (1.0 + cosw0) / 2.0;
+        a[0] = 1.0 + alpha;
+        a[1] = -2.0 * cosw0;
+        a[2] = 1.0 - alpha;
+        break;
+    }
+    for (n = 1; n < 3; n++) {
+        b[n] /= a[0];
+        a[n] /= a[0];
+    }
+    b[0] /= a[0];
+    a[0] = 1.0;
+    pb->num[0] = b[0] * b[0] + b[1] * b[1] + b[2] * b[2] - 2.0 * b[0] * b[2];
+    pb->num[1] = 2.0 * (b[0] * b[1] + b[1] * b[2]);
+    pb->num[2] = 4.0 * b[0] * b[2];
+    pb->den[0] = a[0] * a[0] + a[1] * a[1] + a[2] * a[2] - 2.0 * a[0] * a[2];
+    pb->den[1] = 2.0 * (a[0] * a[1] + a[1] * a[2]);
+    pb->den[2] = 4.0 * a[0] * a[2];
+}
+
+/* Combined magnitude of the parametric bands for bins 0 to taps / 2. The
+   cosine table is made with a recurrence, and the band loop is kept simple
+   so the compiler can vectorise it. */
+static double *
+parametric_response(struct realtime_eq *eq)
+{
+    double *cosw, *mag, c1, num, den;
+    struct parametric_band *pb;
+    int n, i, half;
+
+    half = eq->taps >> 1;
+    cosw = pbuf;
+    mag = &pbuf[half + 1];
+    c1 = cos(2.0 * M_PI / (double)eq->taps);
+    cosw[0] = 1.0;
+    cosw[1] = c1;
+    for (n = 2; n <= half; n++) {
+        if ((n & 0xFF) == 0) {
+            /* limit accumulated rounding errors */
+            cosw[n] = cos(2.0 * M_PI * (double)n / (double)eq->taps);
+        } else {
+            cosw[n] = 2.0 * c1 * cosw[n-1] - cosw[n-2];
+        }
+    }
+    for (n = 0; n <= half; n++) {
+        mag[n] = 1.0;
+    }
+    for (i = 0; i < eq->n_pbands; i++) {
+        pb = &eq->pbands[i];
+        for (n = 0; n <= half; n++) {
+            num = pb->num[0] + cosw[n] * (pb->num[1] + cosw[n] * pb->num[2]);
+            den = pb->den[0] + cosw[n] * (pb->den[1] + cosw[n] * pb->den[2]);
+            mag[n] *= num / den;
+        }
+    }
+    for (n = 0; n <= half; n++) {
+        /* rounding may give tiny negatives where a filter has a zero */
+        mag[n] = mag[n] > 0.0 ? sqrt(mag[n]) : 0.0;
+    }
+    return mag;
+}
 
 #define real_t float
 #define REALSIZE 4
-#define COSINE_INT_NAME cosine_int_f
 #define RENDER_EQUALISER_NAME render_equaliser_f
+#define MINIMUM_PHASE_NAME minimum_phase_f
 #include "rendereq.h"
-#undef COSINE_INT_NAME
+#undef MINIMUM_PHASE_NAME
 #undef RENDER_EQUALISER_NAME
 #undef REALSIZE
 #undef real_t
 
 #define real_t double
 #define REALSIZE 8
-#define COSINE_INT_NAME cosine_int_d
 #define RENDER_EQUALISER_NAME render_equaliser_d
+#define MINIMUM_PHASE_NAME minimum_phase_d
 #include "rendereq.h"
-#undef COSINE_INT_NAME
+#undef MINIMUM_PHASE_NAME
 #undef RENDER_EQUALISER_NAME
 #undef REALSIZE
 #undef real_t
@@ -101,19 +249,45 @@ strtrim(char s[])
     return s;
 }
 
+static bool_t
+eq_has_coeff(struct realtime_eq *eq,
+             int coeff)
+{
+    int n;
+
+    for (n = 0; n < eq->n_slots; n++) {
+        if (eq->coeff[n] == coeff) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Called by the filter process(es) each block. When a newly rendered slot is
+   picked up, the renderer is woken up if it is waiting for a free slot. */
 static void
 coeff_final(int filter,
             int *coeff)
 {
-    int n, c[2], active;
+    struct realtime_eq *eq;
+    uint8_t dummy = 0;
+    int n, active;
 
     for (n = 0; n < n_equalisers; n++) {
-        c[0] = equalisers[n].coeff[0];
-        c[1] = equalisers[n].coeff[1];
-        active = c[equalisers[n].active_coeff];
-        if (*coeff == c[0] || *coeff == c[1]) {
-            *coeff = active;
-            equalisers[n].not_changed = false;
+        eq = &equalisers[n];
+        if (!eq_has_coeff(eq, *coeff)) {
+            continue;
+        }
+        active = eq->active_slot;
+        *coeff = eq->coeff[active];
+        if (eq->picked_up_slot != active) {
+            eq->picked_up_slot = active;
+            MEMORY_BARRIER();
+            if (eq->waiting) {
+                eq->waiting = false;
+                /* non-blocking, a full pipe means a wakeup is pending anyway */
+                (void)!write(notify_pipe[1], &dummy, 1);
+            }
         }
     }
 }
@@ -174,7 +348,7 @@ finalise_equaliser(struct realtime_eq *eq,
         eq->phase[n] = eq->phase[n] / (180 * M_PI);           
     }
     eq->band_count = band_count;
-    for (n = i = 0; n < 2; n++) {
+    for (n = i = 0; n < eq->n_slots; n++) {
         if (!coeffs[eq->coeff[n]].is_shared) {
             fprintf(stderr, "EQ: Coefficient %d must be in shared memory.\n",
                     eq->coeff[n]);
@@ -188,10 +362,12 @@ finalise_equaliser(struct realtime_eq *eq,
         }
     }
     eq->taps = 1 << i;
-    if (coeffs[eq->coeff[0]].n_blocks != coeffs[eq->coeff[1]].n_blocks) {
-        fprintf(stderr, "EQ: Coefficient %d and %d must be the same length.\n",
-                eq->coeff[0], eq->coeff[1]);
-        return false;
+    for (n = 1; n < eq->n_slots; n++) {
+        if (coeffs[eq->coeff[0]].n_blocks != coeffs[eq->coeff[n]].n_blocks) {
+            fprintf(stderr, "EQ: Coefficient %d and %d must be the same "
+                    "length.\n", eq->coeff[0], eq->coeff[n]);
+            return false;
+        }
     }
     return true;
 }
@@ -239,6 +415,74 @@ parse_freq_val(int (*get_config_token)(union bflexval *lexval),
     return n;
 }
 
+static int
+pband_type(const char name[])
+{
+    int n;
+
+    for (n = 0; pband_names[n] != NULL; n++) {
+        if (strcmp(name, pband_names[n]) == 0) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+static const char *
+check_pband(struct parametric_band *pb)
+{
+    if (pb->freq <= 0 || pb->freq >= (double)sample_rate / 2.0) {
+        return "parametric band frequency must be between 0 and nykvist";
+    }
+    if (pb->q <= 0) {
+        return "parametric band Q must be larger than 0";
+    }
+    return NULL;
+}
+
+/* "<type>"/<freq>/<Q>[/<gain>][, ...] */
+static int
+parse_parametric(int (*get_config_token)(union bflexval *lexval),
+                 struct parametric_band pbands[])
+{
+    union bflexval lexval;
+    const char *err;
+    int n, token;
+
+    token = BF_LEX_COMMA;
+    for (n = 0; n < MAX_PBANDS && token == BF_LEX_COMMA; n++) {
+        memset(&pbands[n], 0, sizeof(struct parametric_band));
+        GET_TOKEN(BF_LEXVAL_STRING, "expected string.\n");
+        if ((pbands[n].type = pband_type(lexval.string)) == -1) {
+            fprintf(stderr, "EQ: Parse error: unknown parametric band type "
+                    "\"%s\".\n", lexval.string);
+            return -1;
+        }
+        GET_TOKEN(BF_LEX_SLASH, "expected slash (/).\n");
+        GET_TOKEN(BF_LEXVAL_REAL, "expected real.\n");
+        pbands[n].freq = lexval.real;
+        GET_TOKEN(BF_LEX_SLASH, "expected slash (/).\n");
+        GET_TOKEN(BF_LEXVAL_REAL, "expected real.\n");
+        pbands[n].q = lexval.real;
+        token = get_config_token(&lexval);
+        if (token == BF_LEX_SLASH) {
+            GET_TOKEN(BF_LEXVAL_REAL, "expected real.\n");
+            pbands[n].gain = lexval.real;
+            token = get_config_token(&lexval);
+        }
+        if ((err = check_pband(&pbands[n])) != NULL) {
+            fprintf(stderr, "EQ: Parse error: %s.\n", err);
+            return -1;
+        }
+        parametric_band_setup(&pbands[n]);
+    }
+    if (token != BF_LEX_EOS) {
+        fprintf(stderr, "EQ: Parse error: expected end of statement (;).\n");
+        return -1;
+    }
+    return n;
+}
+
 int
 bflogic_preinit(int *version_major,
                 int *version_minor,
@@ -261,7 +505,7 @@ bflogic_preinit(int *version_major,
     double bands[MAX_BANDS];
     int n_mag, n_phase, n_bands;
     union bflexval lexval;
-    int token, n, i, ver;
+    int token, n, i, k, ver;
     char *p;
 
     ver = *version_major;
@@ -297,7 +541,6 @@ bflogic_preinit(int *version_major,
             }
             memset(&equalisers[n_equalisers], 0, sizeof(struct realtime_eq));
             equalisers[n_equalisers].coeff[0] = -1;
-            equalisers[n_equalisers].coeff[1] = -1;
             n_mag = 0;
             n_phase = 0;
             n_bands = -1;
@@ -308,7 +551,18 @@ bflogic_preinit(int *version_major,
                         return -1;
                     }
                     if (n_bands == -1) {
-                        fprintf(stderr, "EQ: Parse error: bands not set.\n");
+                        if (equalisers[n_equalisers].n_pbands == 0) {
+                            fprintf(stderr, "EQ: Parse error: bands not "
+                                    "set.\n");
+                            return -1;
+                        }
+                        n_bands = 0;
+                    }
+                    if (equalisers[n_equalisers].minimum_phase &&
+                        n_phase > 0)
+                    {
+                        fprintf(stderr, "EQ: Parse error: phase cannot be set "
+                                "for a minimum phase equaliser.\n");
                         return -1;
                     }
                     if (!finalise_equaliser(&equalisers[n_equalisers],
@@ -428,7 +682,7 @@ bflogic_preinit(int *version_major,
                         return -1;
                     }
                 } else if (strcmp(lexval.field, "coeff") == 0) {
-                    for (i = 0; i < 2; i++) {
+                    for (i = 0; i < MAX_SLOTS; i++) {
                         token = get_config_token(&lexval);
                         if (token != BF_LEXVAL_STRING &&
                             token != BF_LEXVAL_REAL)
@@ -462,23 +716,44 @@ bflogic_preinit(int *version_major,
                                 return -1;
                             }
                         }
-                        token = get_config_token(&lexval);
-                        if (i == 0) {
-                            if (token == BF_LEX_EOS) {
-                                equalisers[n_equalisers].coeff[1] =
-                                    equalisers[n_equalisers].coeff[0];
-                                break;
-                            } else if (token != BF_LEX_COMMA) {
-                                fprintf(stderr, "EQ: Parse error: expected "
-                                        "comma.\n");
+                        for (n = 0; n < i; n++) {
+                            if (equalisers[n_equalisers].coeff[n] ==
+                                equalisers[n_equalisers].coeff[i])
+                            {
+                                fprintf(stderr, "EQ: Coefficient %d given "
+                                        "twice.\n",
+                                        equalisers[n_equalisers].coeff[i]);
                                 return -1;
                             }
-                        } else if (token != BF_LEX_EOS) {
-                            fprintf(stderr, "EQ: Parse error: expected end of "
-                                    "statement (;).\n");
+                        }
+                        equalisers[n_equalisers].n_slots = i + 1;
+                        token = get_config_token(&lexval);
+                        if (token == BF_LEX_EOS) {
+                            break;
+                        } else if (token != BF_LEX_COMMA) {
+                            fprintf(stderr, "EQ: Parse error: expected "
+                                    "comma.\n");
                             return -1;
                         }
                     }
+                    if (i == MAX_SLOTS) {
+                        fprintf(stderr, "EQ: Parse error: at most %d "
+                                "coefficients per equaliser.\n", MAX_SLOTS);
+                        return -1;
+                    }
+                } else if (strcmp(lexval.field, "minimum_phase") == 0) {
+                    GET_TOKEN(BF_LEXVAL_BOOLEAN, "expected boolean.\n");
+                    equalisers[n_equalisers].minimum_phase = lexval.boolean;
+                    GET_TOKEN(BF_LEX_EOS, "expected end of statement "
+                              "(;).\n");
+                } else if (strcmp(lexval.field, "parametric") == 0) {
+                    if ((equalisers[n_equalisers].n_pbands =
+                         parse_parametric(get_config_token,
+                                          equalisers[n_equalisers].pbands))
+                        == -1)
+                    {
+                        return -1;
+                    }
                 } else if (strcmp(lexval.field, "magnitude") == 0) {
                     if ((n_mag = parse_freq_val(get_config_token,
                                                 mag[0], mag[1])) == -1)
@@ -527,23 +802,30 @@ bflogic_preinit(int *version_major,
     
     for (n = 0; n < n_equalisers; n++) {
         for (i = 0; i < n_equalisers; i++) {
-            if (i != n &&
-                (equalisers[n].coeff[0] == equalisers[i].coeff[0] ||
-                 equalisers[n].coeff[0] == equalisers[i].coeff[1] ||
-                 equalisers[n].coeff[1] == equalisers[i].coeff[0] ||
-                 equalisers[n].coeff[1] == equalisers[i].coeff[1]))
-            {
-                fprintf(stderr, "EQ: At least two equalisers has at least one "
-                        "coefficent set in common.\n");
-                return -1;
+            if (i == n) {
+                continue;
+            }
+            for (k = 0; k < equalisers[i].n_slots; k++) {
+                if (eq_has_coeff(&equalisers[n], equalisers[i].coeff[k])) {
+                    fprintf(stderr, "EQ: At least two equalisers has at least "
+                            "one coefficent set in common.\n");
+                    return -1;
+                }
             }
         }
     }
 
-    if (pipe(cmdpipe) == -1 || pipe(cmdpipe_reply) == -1) {
+    if (pipe(cmdpipe) == -1 || pipe(cmdpipe_reply) == -1 ||
+        pipe(notify_pipe) == -1)
+    {
         fprintf(stderr, "EQ: Failed to create pipe: %s.\n", strerror(errno));
         return -1;
     }
+    /* the filter process(es) must never block on the notification */
+    if (fcntl(notify_pipe[1], F_SETFL, O_NONBLOCK) == -1) {
+        fprintf(stderr, "EQ: fcntl failed: %s.\n", strerror(errno));
+        return -1;
+    }
     
     return 0;
 }
@@ -564,6 +846,7 @@ bflogic_init(struct bfaccess *_bfaccess,
 {
     int n, maxblocks, command, eq_index, n_bands, i;
     double bands[MAX_BANDS], values[MAX_BANDS], freq;
+    struct parametric_band pbands[MAX_PBANDS];
     int render_postponed_index = -1;
     struct realtime_eq *eq;
     char rmsg[MSGSIZE], *p;
@@ -581,11 +864,17 @@ bflogic_init(struct bfaccess *_bfaccess,
         }
     }
     rbuf = emallocaligned(maxblocks * block_length * bfaccess->realsize);
+    pbuf = emallocaligned((maxblocks * block_length + 2) * sizeof(double));
     
     for (n = 0; n < n_equalisers; n++) {
         equalisers[n].ifftplan =
             bfaccess->convolver_fftplan(log2_get(equalisers[n].taps), true,
                                         true);
+        if (equalisers[n].minimum_phase) {
+            equalisers[n].fftplan =
+                bfaccess->convolver_fftplan(log2_get(equalisers[n].taps),
+                                            false, true);
+        }
         if (bfaccess->realsize == 4) {
             render_equaliser_f(&equalisers[n]);
         } else {
@@ -627,6 +916,22 @@ bflogic_init(struct bfaccess *_bfaccess,
                     i++;
                 }
             }
+            goto render;
+        case CMD_CHANGE_PARAMETRIC:
+            if (!readfd(cmdpipe[0], &n_bands, sizeof(int)) ||
+                !readfd(cmdpipe[0], pbands,
+                        n_bands * sizeof(struct parametric_band)))
+            {
+                fprintf(stderr, "EQ: read failed.\n");
+                return -1;
+            }
+            for (n = 0; n < n_bands; n++) {
+                parametric_band_setup(&pbands[n]);
+            }
+            memcpy(eq->pbands, pbands,
+                   n_bands * sizeof(struct parametric_band));
+            eq->n_pbands = n_bands;
+        render:
             if (render_postponed_index == eq_index) {
                 render_postponed_index = -1;
             }
@@ -655,12 +960,14 @@ bflogic_init(struct bfaccess *_bfaccess,
         case CMD_GET_INFO:
             p = rmsg;
             memset(rmsg, 0, sizeof(rmsg));
-            if (eq->coeff[0] == eq->coeff[1]) {
-                sprintf(p, "coefficient %d:\n band: ", eq->coeff[0]);
-            } else {
-                sprintf(p, "coefficient %d,%d:\n band: ",
-                        eq->coeff[0], eq->coeff[1]);
+            sprintf(p, "coefficient %d", eq->coeff[0]);
+            p += strlen(p);
+            for (n = 1; n < eq->n_slots; n++) {
+                sprintf(p, ",%d", eq->coeff[n]);
+                p += strlen(p);
             }
+            sprintf(p, "%s:\n band: ",
+                    eq->minimum_phase ? " (minimum phase)" : "");
             p += strlen(p);
             for (n = 1; n < eq->band_count - 1; n++) {
                 freq = eq->freq[n] * (double)sample_rate;
@@ -684,6 +991,19 @@ bflogic_init(struct bfaccess *_bfaccess,
                 p += strlen(p);
             }
             sprintf(p, "\n");
+            p += strlen(p);
+            if (eq->n_pbands > 0) {
+                sprintf(p, "param:");
+                p += strlen(p);
+                for (n = 0; n < eq->n_pbands; n++) {
+                    sprintf(p, "%s %s %.1f/%.2f/%.1f", n > 0 ? "," : "",
+                            pband_names[eq->pbands[n].type],
+                            eq->pbands[n].freq, eq->pbands[n].q,
+                            eq->pbands[n].gain);
+                    p += strlen(p);
+                }
+                sprintf(p, "\n");
+            }
             if (!writefd(cmdpipe_reply[1], rmsg, sizeof(rmsg))) {
                 fprintf(stderr, "EQ: write failed.\n");
                 return -1;
@@ -708,13 +1028,16 @@ bflogic_command(const char params[])
     int command, coeff, n, i, n_bands, eq_index;
     char *p, *params_copy, *cmd;
     double bands[MAX_BANDS], values[MAX_BANDS];
+    struct parametric_band pbands[MAX_PBANDS];
     struct realtime_eq *eq;
+    const char *err;
 
     params_copy = estrdup(params);
     cmd = strtrim(params_copy);
     coeff = -1;
     
-    /* <coeff> <mag | phase | info> <band>/<value>[,<band/value>, ...] */
+    /* <coeff> <mag | phase | info> <band>/<value>[,<band/value>, ...]
+       <coeff> param [<type> <freq>/<Q>[/<gain>][, ...]] */
     if (cmd[0] == '\"') {
         p = strchr(cmd + 1, '\"');
         if (p == NULL) {
@@ -745,9 +1068,7 @@ bflogic_command(const char params[])
         }
     }
     for (n = 0; n < n_equalisers; n++) {
-        if (equalisers[n].coeff[0] == coeff ||
-            equalisers[n].coeff[1] == coeff)
-        {
+        if (eq_has_coeff(&equalisers[n], coeff)) {
             eq_index = n;
             break;
         }
@@ -758,12 +1079,20 @@ bflogic_command(const char params[])
         return -1;
     }
     cmd = strtrim(p);
+    if (strstr(cmd, "phase") == cmd && equalisers[eq_index].minimum_phase) {
+        sprintf(msg, "Phase cannot be set for a minimum phase equaliser.\n");
+        free(params_copy);
+        return -1;
+    }
     if (strstr(cmd, "mag") == cmd) {
         command = CMD_CHANGE_MAGNITUDE;
         cmd = strtrim(cmd + 3);
     } else if (strstr(cmd, "phase") == cmd) {
         command = CMD_CHANGE_PHASE;
         cmd = strtrim(cmd + 5);
+    } else if (strstr(cmd, "param") == cmd) {
+        command = CMD_CHANGE_PARAMETRIC;
+        cmd = strtrim(cmd + 5);
     } else if (strstr(cmd, "info") == cmd) {
         command = CMD_GET_INFO;
     } else {
@@ -837,6 +1166,72 @@ bflogic_command(const char params[])
         }
         sprintf(msg, "ok\n");
         break;
+    case CMD_CHANGE_PARAMETRIC:
+        for (n = 0; n < MAX_PBANDS && cmd[0] != '\0'; n++) {
+            memset(&pbands[n], 0, sizeof(struct parametric_band));
+            for (p = cmd; *p != '\0' && *p != ' ' && *p != '\t'; p++);
+            if (*p != '\0') {
+                *p++ = '\0';
+            }
+            if ((pbands[n].type = pband_type(cmd)) == -1) {
+                sprintf(msg, "Unknown parametric band type \"%.32s\".\n",
+                        cmd);
+                free(params_copy);
+                return -1;
+            }
+            cmd = strtrim(p);
+            pbands[n].freq = strtod(cmd, &p);
+            if (p == cmd || *p != '/') {
+                sprintf(msg, "Invalid parametric band list.\n");
+                free(params_copy);
+                return -1;
+            }
+            cmd = p + 1;
+            pbands[n].q = strtod(cmd, &p);
+            if (p == cmd) {
+                sprintf(msg, "Invalid parametric band list.\n");
+                free(params_copy);
+                return -1;
+            }
+            if (*p == '/') {
+                cmd = p + 1;
+                pbands[n].gain = strtod(cmd, &p);
+                if (p == cmd) {
+                    sprintf(msg, "Invalid parametric band list.\n");
+                    free(params_copy);
+                    return -1;
+                }
+            }
+            if ((err = check_pband(&pbands[n])) != NULL) {
+                sprintf(msg, "Invalid %s.\n", err);
+                free(params_copy);
+                return -1;
+            }
+            cmd = strtrim(p);
+            if (cmd[0] != ',' && cmd[0] != '\0') {
+                sprintf(msg, "Invalid parametric band list.\n");
+                free(params_copy);
+                return -1;
+            }
+            if (cmd[0] == ',') {
+                cmd = strtrim(cmd + 1);
+            }
+        }
+        free(params_copy);
+        n_bands = n;
+        /* <int: command><int: eq index><int: n_bands>
+           <struct parametric_band: bands> */
+        if (!writefd(cmdpipe[1], &command, sizeof(int)) ||
+            !writefd(cmdpipe[1], &eq_index, sizeof(int)) ||
+            !writefd(cmdpipe[1], &n_bands, sizeof(int)) ||
+            !writefd(cmdpipe[1], pbands,
+                     n_bands * sizeof(struct parametric_band)))
+        {
+            sprintf(msg, "Write failed: %s.\n", strerror(errno));
+            return -1;
+        }
+        sprintf(msg, "ok\n");
+        break;
     case CMD_GET_INFO:
         if (!writefd(cmdpipe[1], &command, sizeof(int)) ||
             !writefd(cmdpipe[1], &eq_index, sizeof(int)))
@@ -0,0 +1,453 @@
+/*
+ * (c) Copyright 2026 -- Anders Torger
+ *
+ * This program is open source. For license terms, see the LICENSE file.
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#define IS_BFLOGIC_MODULE
+#include "bfmod.h"
+#include "defs.h"
+#include "inout.h"
+#include "bfshm.h"
+
+static struct bfshm_header *header = NULL;
+static uint8_t *control_copy;
+static uint8_t *control_applied;
+static uint32_t control_size;
+static uint32_t applied_seq;
+static bool_t filled = false;
+static bool_t *fchanged;
+static struct bflevel *levels[2];
+static unsigned int level_frame = 0;
+static int n_filters;
+static const struct bffilter *filters;
+static int n_coeffs;
+static int n_maxblocks;
+static int n_channels[2];
+static char *path = NULL;
+
+/* The layout is addressed with the values set in preinit, since the header
+   of the file can be written to by the clients. The control copies have the
+   same layout as the file. */
+static uint32_t filter_stride;
+static uint32_t filters_offset;
+static uint32_t channels_offset;
+static uint32_t meters_offset;
+static uint32_t levels_offset;
+
+#define FILTER(base, index)                                                    \
+    ((struct bfshm_filter *)((uint8_t *)(base) + filters_offset +             \
+                             (index) * filter_stride))
+#define CHANNEL(base, io, index)                                               \
+    (&((struct bfshm_channel *)((uint8_t *)(base) + channels_offset))         \
+     [(io) == IN ? (index) : n_channels[IN] + (index)])
+#define METER(base, index)                                                     \
+    (&((struct bfshm_meter *)((uint8_t *)(base) + meters_offset))[index])
+#define LEVEL(base, io, index)                                                 \
+    (&((struct bfshm_level *)((uint8_t *)(base) + levels_offset))             \
+     [(io) == IN ? (index) : n_channels[IN] + (index)])
+
+static void
+copy_name(char dest[BFSHM_MAXNAME],
+          const char src[])
+{
+    size_t len;
+
+    len = strlen(src);
+    if (len > BFSHM_MAXNAME - 1) {
+        len = BFSHM_MAXNAME - 1;
+    }
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+}
+
+static void
+fill_control(struct bfaccess *bfaccess)
+{
+    struct bfshm_filter *f;
+    int n, i, k;
+
+    for (n = 0; n < n_filters; n++) {
+        f = FILTER(header, n);
+        f->coeff = bfaccess->fctrl[n].coeff;
+        f->delayblocks = bfaccess->fctrl[n].delayblocks;
+        k = 0;
+        FOR_IN_AND_OUT {
+            for (i = 0; i < filters[n].n_channels[IO]; i++) {
+                f->scale[k++] = bfaccess->fctrl[n].scale[IO][i];
+            }
+        }
+        for (i = 0; i < filters[n].n_filters[IN]; i++) {
+            f->scale[k++] = bfaccess->fctrl[n].fscale[i];
+        }
+    }
+    FOR_IN_AND_OUT {
+        for (n = 0; n < n_channels[IO]; n++) {
+            CHANNEL(header, IO, n)->delay = bfaccess->get_delay(IO, n);
+            CHANNEL(header, IO, n)->muted = bfaccess->ismuted(IO, n);
+        }
+    }
+    memcpy(&control_applied[filters_offset], (uint8_t *)header +
+           filters_offset, control_size);
+}
+
+/* The control area is compared with the image last applied, and only what
+   the clients have changed since then is applied, so changes made in other
+   ways, for example through the CLI, are left alone unless a client changes
+   the same thing. Filter changes are made in one go under the control
+   mutex. */
+static void
+apply_control(struct bfaccess *bfaccess)
+{
+    volatile struct bffilter_control *fctrl = bfaccess->fctrl;
+    struct bfshm_channel *ch, *ach;
+    struct bfshm_filter *f, *af;
+    bool_t changed;
+    uint32_t seq;
+    int n, i, k;
+
+    seq = header->control_seq;
+    if ((seq & 1) != 0 || seq == applied_seq) {
+        return;
+    }
+    MEMORY_BARRIER();
+    memcpy(&control_copy[filters_offset], (uint8_t *)header + filters_offset,
+           control_size);
+    MEMORY_BARRIER();
+    if (seq != header->control_seq) {
+        /* a client is writing, try again next block */
+        return;
+    }
+    applied_seq = seq;
+
+    changed = false;
+    for (n = 0; n < n_filters; n++) {
+        f = FILTER(control_copy, n);
+        af = FILTER(control_applied, n);
+        fchanged[n] = false;
+        if (f->coeff != af->coeff) {
+            if (f->coeff < -1 || f->coeff >= n_coeffs) {
+                fprintf(stderr, "SHM: Invalid coefficient set %d for filter "
+                        "%d.\n", f->coeff, n);
+                af->coeff = f->coeff;
+            } else {
+                fchanged[n] = true;
+            }
+        }
+        if (f->delayblocks != af->delayblocks) {
+            if (f->delayblocks < 0 || f->delayblocks > n_maxblocks - 1) {
+                fprintf(stderr, "SHM: Invalid delay %d for filter %d.\n",
+                        f->delayblocks, n);
+                af->delayblocks = f->delayblocks;
+            } else {
+                fchanged[n] = true;
+            }
+        }
+        k = filters[n].n_channels[IN] + filters[n].n_channels[OUT] +
+            filters[n].n_filters[IN];
+        for (i = 0; i < k; i++) {
+            if (f->scale[i] != af->scale[i]) {
+                fchanged[n] = true;
+            }
+        }
+        changed = changed || fchanged[n];
+    }
+    if (changed) {
+        bfaccess->control_mutex(1);
+        for (n = 0; n < n_filters; n++) {
+            if (!fchanged[n]) {
+                continue;
+            }
+            f = FILTER(control_copy, n);
+            af = FILTER(control_applied, n);
+            if (f->coeff != af->coeff) {
+                fctrl[n].coeff = f->coeff;
+                af->coeff = f->coeff;
+            }
+            if (f->delayblocks != af->delayblocks) {
+                fctrl[n].delayblocks = f->delayblocks;
+                af->delayblocks = f->delayblocks;
+            }
+            k = 0;
+            FOR_IN_AND_OUT {
+                for (i = 0; i < filters[n].n_channels[IO]; i++, k++) {
+                    if (f->scale[k] != af->scale[k]) {
+                        fctrl[n].scale[IO][i] = f->scale[k];
+                        af->scale[k] = f->scale[k];
+                    }
+                }
+            }
+            for (i = 0; i < filters[n].n_filters[IN]; i++, k++) {
+                if (f->scale[k] != af->scale[k]) {
+                    fctrl[n].fscale[i] = f->scale[k];
+                    af->scale[k] = f->scale[k];
+                }
+            }
+        }
+        bfaccess->control_mutex(0);
+    }
+
+    FOR_IN_AND_OUT {
+        for (n = 0; n < n_channels[IO]; n++) {
+            ch = CHANNEL(control_copy, IO, n);
+            ach = CHANNEL(control_applied, IO, n);
+            if (ch->delay != ach->delay) {
+                ach->delay = ch->delay;
+                if (bfaccess->set_delay(IO, n, ch->delay) == -1) {
+                    fprintf(stderr, "SHM: Could not change %s delay.\n",
+                            IO == IN ? "input" : "output");
+                }
+            }
+            if (ch->muted != ach->muted) {
+                ach->muted = ch->muted;
+                if (!!ch->muted != !!bfaccess->ismuted(IO, n)) {
+                    bfaccess->toggle_mute(IO, n);
+                }
+            }
+        }
+    }
+}
+
+static void
+publish_meters(struct bfaccess *bfaccess,
+               unsigned int block_index)
+{
+    struct bfshm_meter *meter;
+    struct bfshm_level *level;
+    bool_t new_levels;
+    unsigned int frame;
+    double peak;
+    int n;
+
+    new_levels = bfaccess->read_levels(levels, &frame) == 0 &&
+        frame != level_frame;
+    header->meter_seq++;
+    MEMORY_BARRIER();
+    for (n = 0; n < n_channels[OUT]; n++) {
+        meter = METER(header, n);
+        peak = bfaccess->overflow[n].largest;
+        if (peak < (double)bfaccess->overflow[n].intlargest) {
+            peak = (double)bfaccess->overflow[n].intlargest;
+        }
+        meter->peak = peak / bfaccess->overflow[n].max;
+        meter->n_overflows = bfaccess->overflow[n].n_overflows;
+    }
+    if (new_levels) {
+        FOR_IN_AND_OUT {
+            for (n = 0; n < n_channels[IO]; n++) {
+                level = LEVEL(header, IO, n);
+                level->peak = levels[IO][n].peak;
+                level->rms = levels[IO][n].rms;
+            }
+        }
+        level_frame = frame;
+        header->level_frame = frame;
+    }
+    header->block_index = block_index;
+    MEMORY_BARRIER();
+    header->meter_seq++;
+}
+
+static void
+block_start(struct bfaccess *bfaccess,
+            unsigned int block_index,
+            struct timeval *current_time)
+{
+    if (!filled) {
+        filled = true;
+        fill_control(bfaccess);
+        applied_seq = header->control_seq;
+        MEMORY_BARRIER();
+        header->ready = 1;
+    }
+    apply_control(bfaccess);
+    publish_meters(bfaccess, block_index);
+}
+
+int
+bflogic_preinit(int *version_major,
+                int *version_minor,
+                int (*get_config_token)(union bflexval *lexval),
+                int sample_rate,
+                int block_length,
+                int _n_maxblocks,
+                int _n_coeffs,
+                const struct bfcoeff _coeffs[],
+                const int _n_channels[2],
+                const struct bfchannel *_channels[2],
+                int _n_filters,
+                const struct bffilter _filters[],
+                struct bfevents *bfevents,
+                int *fork_mode,
+                int _debug)
+{
+    pthread_mutexattr_t attr;
+    uint32_t size;
+    struct bfshm_filter *f;
+    union bflexval lexval;
+    int token, ver, n, i, fd, max_scales;
+    void *p;
+
+    ver = *version_major;
+    *version_major = BF_VERSION_MAJOR;
+    *version_minor = BF_VERSION_MINOR;
+    if (ver != BF_VERSION_MAJOR) {
+        return -1;
+    }
+
+    while ((token = get_config_token(&lexval)) > 0) {
+        if (token != BF_LEXVAL_FIELD) {
+            fprintf(stderr, "SHM: Parse error: expected field.\n");
+            return -1;
+        }
+        if (strcmp(lexval.field, "path") == 0) {
+            if (get_config_token(&lexval) != BF_LEXVAL_STRING) {
+                fprintf(stderr, "SHM: Parse error: expected string.\n");
+                return -1;
+            }
+            path = strdup(lexval.string);
+        } else {
+            fprintf(stderr, "SHM: Parse error: unknown field \"%s\".\n",
+                    lexval.field);
+            return -1;
+        }
+        if (get_config_token(&lexval) != BF_LEX_EOS) {
+            fprintf(stderr, "SHM: Parse error: expected end of "
+                    "statement (;).\n");
+            return -1;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "SHM: \"path\" must be set.\n");
+        return -1;
+    }
+
+    n_filters = _n_filters;
+    filters = _filters;
+    n_coeffs = _n_coeffs;
+    n_maxblocks = _n_maxblocks;
+    n_channels[IN] = _n_channels[IN];
+    n_channels[OUT] = _n_channels[OUT];
+
+    max_scales = 0;
+    for (n = 0; n < n_filters; n++) {
+        i = filters[n].n_channels[IN] + filters[n].n_channels[OUT] +
+            filters[n].n_filters[IN];
+        if (i > max_scales) {
+            max_scales = i;
+        }
+    }
+    filter_stride = sizeof(struct bfshm_filter) + max_scales * sizeof(double);
+    filter_stride = (filter_stride + 7) & ~7;
+    filters_offset = (sizeof(struct bfshm_header) + 7) & ~7;
+    channels_offset = filters_offset + n_filters * filter_stride;
+    meters_offset = channels_offset +
+        (n_channels[IN] + n_channels[OUT]) * sizeof(struct bfshm_channel);
+    levels_offset = meters_offset +
+        n_channels[OUT] * sizeof(struct bfshm_meter);
+    size = levels_offset +
+        (n_channels[IN] + n_channels[OUT]) * sizeof(struct bfshm_level);
+    control_size = meters_offset - filters_offset;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP)) == -1)
+    {
+        fprintf(stderr, "SHM: Could not create \"%s\": %s.\n", path,
+                strerror(errno));
+        return -1;
+    }
+    if (ftruncate(fd, size) == -1) {
+        fprintf(stderr, "SHM: ftruncate failed: %s.\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    /* mapped here, before the filter processes are forked */
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "SHM: mmap failed: %s.\n", strerror(errno));
+        return -1;
+    }
+    if ((control_copy = malloc(size)) == NULL ||
+        (control_applied = malloc(size)) == NULL ||
+        (fchanged = malloc((n_filters + 1) * sizeof(bool_t))) == NULL ||
+        (levels[IN] = malloc((n_channels[IN] + 1) *
+                             sizeof(struct bflevel))) == NULL ||
+        (levels[OUT] = malloc((n_channels[OUT] + 1) *
+                              sizeof(struct bflevel))) == NULL)
+    {
+        fprintf(stderr, "SHM: Memory allocation failure.\n");
+        return -1;
+    }
+    header = (struct bfshm_header *)p;
+    memset(header, 0, size);
+    header->magic = BFSHM_MAGIC;
+    header->version = BFSHM_VERSION;
+    header->size = size;
+    header->sample_rate = sample_rate;
+    header->block_length = block_length;
+    header->n_filters = n_filters;
+    header->n_channels[IN] = n_channels[IN];
+    header->n_channels[OUT] = n_channels[OUT];
+    header->filter_stride = filter_stride;
+    header->filters_offset = filters_offset;
+    header->channels_offset = channels_offset;
+    header->meters_offset = meters_offset;
+    header->levels_offset = levels_offset;
+    if (pthread_mutexattr_init(&attr) != 0 ||
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0 ||
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0 ||
+        pthread_mutex_init(&header->lock, &attr) != 0)
+    {
+        fprintf(stderr, "SHM: Failed to initialise the client mutex.\n");
+        return -1;
+    }
+    pthread_mutexattr_destroy(&attr);
+    for (n = 0; n < n_filters; n++) {
+        f = FILTER(header, n);
+        copy_name(f->name, filters[n].name);
+        f->n_channels[IN] = filters[n].n_channels[IN];
+        f->n_channels[OUT] = filters[n].n_channels[OUT];
+        f->n_filters = filters[n].n_filters[IN];
+    }
+    FOR_IN_AND_OUT {
+        for (n = 0; n < n_channels[IO]; n++) {
+            copy_name(CHANNEL(header, IO, n)->name, _channels[IO][n].name);
+        }
+    }
+    memcpy(control_copy, header, size);
+    memcpy(control_applied, header, size);
+
+    bfevents->block_start = block_start;
+    *fork_mode = BF_FORK_DONT_FORK;
+    return 0;
+}
+
+int
+bflogic_init(struct bfaccess *bfaccess,
+	     int sample_rate,
+	     int block_length,
+	     int _n_maxblocks,
+	     int _n_coeffs,
+	     const struct bfcoeff _coeffs[],
+	     const int _n_channels[2],
+	     const struct bfchannel *_channels[2],
+	     int _n_filters,
+	     const struct bffilter _filters[],
+	     int event_fd,
+             int synch_fd)
+{
+    return 0;
+}
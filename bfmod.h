@@ -16,16 +16,16 @@ extern "C" {
 #include <sys/time.h>
 #include <sched.h>
 
-#define BF_VERSION_MAJOR 2
-#define BF_VERSION_MINOR 0
+#define BF_VERSION_MAJOR 3
+#define BF_VERSION_MINOR 3
     
 /* limits */
-#define BF_MAXCHANNELS 256
-#define BF_MAXFILTERS 256
+#define BF_MAXCHANNELS 4096
+#define BF_MAXFILTERS 4096
 #define BF_MAXMODULES 256
 #define BF_MAXOBJECTNAME 128
 #define BF_MAXCOEFFPARTS 128
-#define BF_MAXPROCESSES 64
+#define BF_MAXPROCESSES 1024
 
 #define BF_IN 0
 #define BF_OUT 1
@@ -103,6 +103,12 @@ struct bfoverflow {
     double max;
 };
 
+/* levels relative to full scale, that is 1.0 is 0 dB */
+struct bflevel {
+    float peak;
+    float rms;
+};
+
 struct bfcoeff {
     int is_shared;
     char name[BF_MAXOBJECTNAME];
@@ -125,11 +131,16 @@ struct bffilter {
     int *filters[2];
 };
 
+/*
+ * Scales are only stored for the connections that exist, that is scale[IN][n]
+ * is the scale of the filter's n'th input channel, and fscale[n] is the scale
+ * of its n'th input filter.
+ */
 struct bffilter_control {
     int coeff;
     int delayblocks;
-    double scale[2][BF_MAXCHANNELS];
-    double fscale[BF_MAXFILTERS];
+    double *scale[2];
+    double *fscale;
 };
 
 struct bfaccess {
@@ -137,6 +148,10 @@ struct bfaccess {
     volatile struct bfoverflow *overflow;
     int realsize;
     void ***coeffs_data;
+/*
+ * Changes to 'fctrl' must be made while holding the control mutex, else the
+ * filter processes will not notice them.
+ */
     void (*control_mutex)(int lock);
     void (*reset_peak)(void);
     void (*exit)(int bf_exit_code);
@@ -187,6 +202,45 @@ struct bfaccess {
                         int subdelay);
     int (*get_subdelay)(int io,
                         int channel);
+
+/*
+ * Reload the given coefficient set in the background, from 'filename' or if
+ * NULL from the file it was last loaded from. The new coefficients are swapped
+ * in at a block boundary, crossfaded if the filter has crossfade set. Only
+ * coefficient sets with the reloadable field set can be reloaded. If the
+ * coefficient set cannot be reloaded, or a reload is already in progress, -1
+ * is returned, else 0. Loading errors are printed on stderr.
+ */
+    int (*reload_coeff)(int coeff,
+                        const char filename[]);
+
+/*
+ * Copy the latest block peak and RMS levels of all input and output channels
+ * to 'levels[BF_IN]' and 'levels[BF_OUT]', which must have room for all
+ * channels. The levels are measured over 1 / meter_rate seconds, and a new set
+ * is available when '*frame' has changed. If metering is off or no levels
+ * have been measured yet, -1 is returned, else 0.
+ */
+    int (*read_levels)(struct bflevel *levels[2],
+                       unsigned int *frame);
+
+/*
+ * Schedule a change of the given filter to the coefficient set, delay and
+ * scales in 'fctrl' at the start of block 'block_index'. All filter processes
+ * make the change at exactly that block, so changes scheduled for the same
+ * block take effect together. The block must be at least two blocks after
+ * current_block(). An immediate change of the filter made when the block has
+ * been reached overrides the scheduled one. If the block is too close, the
+ * queue of scheduled changes is full or 'fctrl' is invalid, -1 is returned,
+ * else 0. The control mutex may be held or not.
+ */
+    int (*schedule_filter)(unsigned int block_index,
+                           int filter,
+                           const struct bffilter_control *fctrl);
+/*
+ * Returns the index of the block being processed, as given to block_start.
+ */
+    unsigned int (*current_block)(void);
 };
 
 struct bfevents {
@@ -21,6 +21,10 @@
 #include <sys/resource.h>
 #include <sched.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <limits.h>
 #ifdef __OS_SUNOS__
 #include <ieeefp.h>
 #endif
@@ -43,6 +47,14 @@
 
 #define DEBUG_MAX_DAI_LOOPS 32
 #define DEBUG_RING_BUFFER_SIZE 1024
+/* without debug, the timestamps are still taken, but in a small ring */
+#define NODEBUG_RING_BUFFER_SIZE 4
+
+/* number of level frames kept in the meter ring */
+#define METER_RING_SIZE 16
+
+/* max number of scheduled filter changes not yet applied */
+#define SCHEDULE_QUEUE_SIZE 64
 
 /* debug structs */
 struct debug_input_process {
@@ -95,33 +107,97 @@ struct debug_filter_process {
 };
 
 
+/* A filter state to take effect at the start of a given block. The scales
+   are stored separately, 'schedule_stride' per entry. */
+struct scheduled_filter {
+    uint32_t valid;
+    uint32_t block;
+    uint32_t id;
+    int filter;
+    int coeff;
+    int delayblocks;
+};
+
+struct shm_usage {
+    size_t total;
+    size_t hugetlb;
+    size_t thp;
+};
+
+/* The arrays are sized after the configuration, and are placed in the same
+   shared memory segment, directly after the struct itself. */
 struct intercomm_area {
     bool_t doreset_overflow;
-    int sync[BF_MAXPROCESSES];
-    uint32_t period_us[BF_MAXPROCESSES];
+    uint32_t ctrl_seq;
+    volatile uint32_t *period_us;
     double realtime_index;
-    struct bffilter_control fctrl[BF_MAXFILTERS];
-    struct bfoverflow overflow[BF_MAXCHANNELS];
-    uint32_t ismuted[2][BF_MAXCHANNELS/32];
-    int delay[2][BF_MAXCHANNELS];
-    int subdelay[2][BF_MAXCHANNELS];
+    volatile struct bffilter_control *fctrl;
+    volatile double *fctrl_scales;
+    volatile int *used_coeff;
+
+    /* Number of filters currently using each coefficient set. A filter
+       process pins a set before it checks that it is loaded, and unpins the
+       previous one when it is done with it. The loader only evicts unpinned
+       sets. */
+    volatile int *coeff_pins;
+    struct {
+        int coeff;
+        char filename[PATH_MAX];
+    } reload;
+    volatile struct bfoverflow *overflow;
+    volatile uint32_t *ismuted[2];
+    volatile int *delay[2];
+    volatile int *subdelay[2];
     int n_pids;
-    pid_t pids[BF_MAXPROCESSES];
+    volatile pid_t *pids;
     int exit_status;
-    bool_t full_proc[BF_MAXPROCESSES];
+    volatile bool_t *full_proc;
     bool_t ignore_rtprio;
 
+    /* Each filter process writes the levels of its own channels to slot
+       'frame % METER_RING_SIZE', inputs first, and then sets its meter_frame
+       to frame + 1. The frames of all processes in the ring are complete up
+       to the smallest meter_frame. */
+    volatile uint32_t *meter_frame;
+    volatile struct bflevel *meter_ring;
+
+    /* Scheduled filter changes are applied by each filter process on its
+       own when its blockcounter reaches the block, and folded into fctrl
+       by the next writer that takes the mutex when all processes have
+       passed it. fctrl_block is the block at which the last immediate change
+       of each filter was made, scheduled changes up to that block are
+       overridden by it. */
+    volatile uint32_t *blockcounter;
+
+    /* Shared memory allocated before the processes were forked, and by each
+       filter process on its own, for the usage report at start. */
+    struct shm_usage shm_usage_main;
+    volatile struct shm_usage *shm_usage;
+    int n_scheduled;
+    uint32_t schedule_id;
+    volatile struct scheduled_filter *schedule;
+    volatile double *schedule_scales;
+    volatile uint32_t *fctrl_block;
+
     struct {
         uint64_t ts_start;
-        struct debug_input_process i[DEBUG_RING_BUFFER_SIZE];
-        struct debug_output_process o[DEBUG_RING_BUFFER_SIZE];
-        struct debug_filter_process f[DEBUG_RING_BUFFER_SIZE];
+        volatile struct debug_input_process *i;
+        volatile struct debug_output_process *o;
+        volatile struct debug_filter_process *f;
         uint32_t periods;
     } debug;
     
 };
 
 static volatile struct intercomm_area *icomm = NULL;
+/* wakes up the coefficient loader process, the write end is non-blocking */
+static int loader_pipe[2] = { -1, -1 };
+static int debug_ring_size;
+static int schedule_stride;
+static int fctrl_n_scales;
+static int *lock_fctrl_ints;
+static double *lock_fctrl_scales;
+static size_t icomm_size;
 static struct bfoverflow *reset_overflow;
 static int bl_output_2_bl_input[2];
 static int bl_output_2_cb_input[2];
@@ -129,6 +205,7 @@ static int cb_output_2_bl_input[2];
 static int cb_input_2_filter[2];
 static int filter_2_cb_output[2];
 static int mutex_pipe[2];
+static bool_t icomm_is_locked = false;
 static int n_callback_devs[2];
 static int n_blocking_devs[2];
 
@@ -258,10 +335,10 @@ print_debug(void)
                  i < D.o[n].dai_loops && i < DEBUG_MAX_DAI_LOOPS;
                  i++)
             {
-                printf("    %" PRIu64 "\tcall select fdmax %d\n",
+                printf("    %" PRIu64 "\tcall wait devsleft %d\n",
                        (ull_t)((D.o[n].d[i].select.ts_call -
                                 D.ts_start) / tsdiv),
-                       D.o[n].d[i].select.fdmax);
+                       D.o[n].d[i].select.devsleft);
                 printf("    %" PRIu64 "\tret %d\n",
                        (ull_t)((D.o[n].d[i].select.ts_ret -
                                 D.ts_start) / tsdiv),
@@ -303,7 +380,7 @@ print_debug(void)
     }
     
     for (n = 0;
-         n < D.periods && n < DEBUG_RING_BUFFER_SIZE - 2;
+         n < D.periods && n < debug_ring_size - 2;
          n++)
     {
         printf("input_process:\n");
@@ -320,9 +397,9 @@ print_debug(void)
              i < D.i[n].dai_loops && i < DEBUG_MAX_DAI_LOOPS;
              i++)
         {
-            printf("    %" PRIu64 "\tcall select fdmax %d\n",
+            printf("    %" PRIu64 "\tcall wait devsleft %d\n",
                    (ull_t)((D.i[n].d[i].select.ts_call - D.ts_start) / tsdiv),
-                   D.i[n].d[i].select.fdmax);
+                   D.i[n].d[i].select.devsleft);
             printf("    %" PRIu64 "\tret %d (%" PRIu64 ")\n",
                    (ull_t)((D.i[n].d[i].select.ts_ret - D.ts_start) / tsdiv),
                    D.i[n].d[i].select.retval,
@@ -402,9 +479,9 @@ print_debug(void)
              i < D.o[n].dai_loops && i < DEBUG_MAX_DAI_LOOPS;
              i++)
         {
-            printf("    %" PRIu64 "\tcall select fdmax %d\n",
+            printf("    %" PRIu64 "\tcall wait devsleft %d\n",
                    (ull_t)((D.o[n].d[i].select.ts_call - D.ts_start) / tsdiv),
-                   D.o[n].d[i].select.fdmax);
+                   D.o[n].d[i].select.devsleft);
             printf("    %" PRIu64 "\tret %d\n",
                    (ull_t)((D.o[n].d[i].select.ts_ret - D.ts_start) / tsdiv),
                    D.o[n].d[i].select.retval);
@@ -452,10 +529,24 @@ ismuted(int io,
     return (int)bit_isset_volatile(icomm->ismuted[io], channel);
 }
 
+static void
+icomm_mutex(int lock);
+
+static bool_t
+icomm_lock_if_unlocked(void)
+{
+    if (icomm_is_locked) {
+        return false;
+    }
+    icomm_mutex(1);
+    return true;
+}
+
 static void
 toggle_mute(int io,
 	    int channel)
 {
+    bool_t unlock;
     int physch;
     
     if ((io != IN && io != OUT) ||
@@ -463,11 +554,15 @@ toggle_mute(int io,
     {
 	return;
     }
+    unlock = icomm_lock_if_unlocked();
     if (bit_isset_volatile(icomm->ismuted[io], channel)) {
         bit_clr_volatile(icomm->ismuted[io], channel);
     } else {
         bit_set_volatile(icomm->ismuted[io], channel);
     }
+    if (unlock) {
+        icomm_mutex(0);
+    }
     
     physch = bfconf->virt2phys[io][channel];
     if (bfconf->n_virtperphys[io][physch] == 1) {
@@ -481,6 +576,7 @@ set_delay(int io,
 	  int channel,
 	  int delay)
 {
+    bool_t unlock;
     int physch;
     
     if ((io != IN && io != OUT) ||
@@ -500,7 +596,11 @@ set_delay(int io,
             return -1;
         }
     }
+    unlock = icomm_lock_if_unlocked();
     icomm->delay[io][channel] = delay;
+    if (unlock) {
+        icomm_mutex(0);
+    }
     return 0;
 }
 
@@ -521,6 +621,8 @@ set_subdelay(int io,
              int channel,
              int subdelay)
 {
+    bool_t unlock;
+
     if ((io != IN && io != OUT) ||
 	channel < 0 || channel >= bfconf->n_channels[io] ||
         subdelay <= -BF_SAMPLE_SLOTS || subdelay >= BF_SAMPLE_SLOTS)
@@ -535,7 +637,11 @@ set_subdelay(int io,
     {
         return -1;
     }
+    unlock = icomm_lock_if_unlocked();
     icomm->subdelay[io][channel] = subdelay;
+    if (unlock) {
+        icomm_mutex(0);
+    }
     return 0;
 }
 
@@ -551,6 +657,96 @@ get_subdelay(int io,
     return icomm->subdelay[io][channel];
 }
 
+static void
+wake_coeff_loader(void)
+{
+    char dummy = 0;
+
+    if (loader_pipe[1] != -1) {
+        /* if the pipe is full the loader has a wake up pending already */
+        (void)!write(loader_pipe[1], &dummy, 1);
+    }
+}
+
+static int
+reload_coeff(int coeff,
+             const char filename[])
+{
+    bool_t unlock;
+
+    if (coeff < 0 || coeff >= bfconf->n_coeffs ||
+        bfconf->coeffs_spare == NULL || bfconf->coeffs_spare[coeff] == NULL ||
+        (filename != NULL && strlen(filename) >= PATH_MAX))
+    {
+        return -1;
+    }
+    unlock = icomm_lock_if_unlocked();
+    if (icomm->reload.coeff != -1) {
+        if (unlock) {
+            icomm_mutex(0);
+        }
+        return -1;
+    }
+    if (filename != NULL) {
+        strcpy((char *)icomm->reload.filename, filename);
+    } else {
+        icomm->reload.filename[0] = '\0';
+    }
+    MEMORY_BARRIER();
+    icomm->reload.coeff = coeff;
+    if (unlock) {
+        icomm_mutex(0);
+    }
+    wake_coeff_loader();
+    return 0;
+}
+
+static int
+read_levels(struct bflevel *levels[2],
+            unsigned int *frame)
+{
+    volatile struct bflevel *slot;
+    uint32_t first, last, f;
+    int n;
+
+    if (bfconf->meter_rate <= 0) {
+        return -1;
+    }
+    do {
+        first = last = icomm->meter_frame[0];
+        for (n = 1; n < bfconf->n_processes; n++) {
+            f = icomm->meter_frame[n];
+            if (f < first) {
+                first = f;
+            }
+        }
+        if (first == 0) {
+            return -1;
+        }
+        MEMORY_BARRIER();
+        slot = &icomm->meter_ring[((first - 1) % METER_RING_SIZE) *
+                                  (bfconf->n_channels[IN] +
+                                   bfconf->n_channels[OUT])];
+        FOR_IN_AND_OUT {
+            for (n = 0; n < bfconf->n_channels[IO]; n++) {
+                levels[IO][n].peak = slot->peak;
+                levels[IO][n].rms = slot->rms;
+                slot++;
+            }
+        }
+        MEMORY_BARRIER();
+        /* if a process has come around the ring the slot may have been
+           overwritten while we copied it */
+        for (n = 0; n < bfconf->n_processes; n++) {
+            if (icomm->meter_frame[n] > last) {
+                last = icomm->meter_frame[n];
+            }
+        }
+    } while (last - first >= METER_RING_SIZE - 1);
+    *frame = first;
+    return 0;
+}
+
 static void
 print_overflows(void)
 {
@@ -619,7 +815,7 @@ check_overflows(struct bfoverflow overflow[])
 static void
 rti_and_overflow(void)
 {
-    static struct bfoverflow overflow[BF_MAXCHANNELS];
+    static struct bfoverflow *overflow;
     static time_t lastprinttime = 0;
     static uint32_t max_period_us;
     static bool_t isinit = false;
@@ -631,6 +827,8 @@ rti_and_overflow(void)
     int n;
 
     if (!isinit) {
+        overflow = emalloc(bfconf->n_channels[OUT] *
+                           sizeof(struct bfoverflow));
         for (n = 0; n < bfconf->n_channels[OUT]; n++) {
             overflow[n] = icomm->overflow[n];
         }
@@ -676,6 +874,209 @@ rti_and_overflow(void)
     }
 }
 
+static void
+blockcounter_range(uint32_t *first,
+                   uint32_t *last)
+{
+    uint32_t b;
+    int n;
+
+    *first = *last = icomm->blockcounter[0];
+    for (n = 1; n < bfconf->n_processes; n++) {
+        b = icomm->blockcounter[n];
+        if ((int32_t)(b - *first) < 0) {
+            *first = b;
+        }
+        if ((int32_t)(b - *last) > 0) {
+            *last = b;
+        }
+    }
+}
+
+/* sort the indexes in 'order' in the order the changes take effect */
+static void
+schedule_sort(int order[],
+              int n_order,
+              const volatile struct scheduled_filter *entries)
+{
+    const volatile struct scheduled_filter *a, *b;
+    int n, i, tmp;
+
+    for (n = 1; n < n_order; n++) {
+        for (i = n; i > 0; i--) {
+            a = &entries[order[i-1]];
+            b = &entries[order[i]];
+            if ((int32_t)(a->block - b->block) < 0 ||
+                (a->block == b->block && (int32_t)(a->id - b->id) < 0))
+            {
+                break;
+            }
+            tmp = order[i-1];
+            order[i-1] = order[i];
+            order[i] = tmp;
+        }
+    }
+}
+
+static void
+schedule_apply(const struct scheduled_filter *sf,
+               const double *scales,
+               volatile struct bffilter_control *fctrl)
+{
+    const struct bffilter *filter;
+    int i;
+
+    filter = &bfconf->filters[sf->filter];
+    fctrl->coeff = sf->coeff;
+    fctrl->delayblocks = sf->delayblocks;
+    FOR_IN_AND_OUT {
+        for (i = 0; i < filter->n_channels[IO]; i++) {
+            fctrl->scale[IO][i] = *scales++;
+        }
+    }
+    for (i = 0; i < filter->n_filters[IN]; i++) {
+        fctrl->fscale[i] = *scales++;
+    }
+}
+
+/* Fold the scheduled changes that all filter processes have passed into the
+   control data, and free their entries. Called with the mutex held. */
+static void
+schedule_fold(void)
+{
+    int order[SCHEDULE_QUEUE_SIZE];
+    struct scheduled_filter sf;
+    uint32_t first, last;
+    int n, n_order;
+
+    if (icomm->n_scheduled == 0) {
+        return;
+    }
+    blockcounter_range(&first, &last);
+    for (n = n_order = 0; n < SCHEDULE_QUEUE_SIZE; n++) {
+        if (icomm->schedule[n].valid &&
+            (int32_t)(icomm->schedule[n].block - first) < 0)
+        {
+            order[n_order++] = n;
+        }
+    }
+    schedule_sort(order, n_order, icomm->schedule);
+    for (n = 0; n < n_order; n++) {
+        sf = icomm->schedule[order[n]];
+        if ((int32_t)(sf.block - icomm->fctrl_block[sf.filter]) > 0) {
+            schedule_apply(&sf, (const double *)
+                           &icomm->schedule_scales[order[n] * schedule_stride],
+                           &icomm->fctrl[sf.filter]);
+        }
+        icomm->schedule[order[n]].valid = 0;
+        icomm->n_scheduled--;
+    }
+}
+
+/* Remember the control data when the mutex is taken, so the filters changed
+   while it was held can be found when it is released. */
+static void
+lock_snapshot(void)
+{
+    int n;
+
+    for (n = 0; n < bfconf->n_filters; n++) {
+        lock_fctrl_ints[2*n+0] = icomm->fctrl[n].coeff;
+        lock_fctrl_ints[2*n+1] = icomm->fctrl[n].delayblocks;
+    }
+    for (n = 0; n < fctrl_n_scales; n++) {
+        lock_fctrl_scales[n] = icomm->fctrl_scales[n];
+    }
+}
+
+static void
+lock_mark_changed(void)
+{
+    uint32_t first, last;
+    int n, i, offset, count;
+    bool_t changed;
+
+    blockcounter_range(&first, &last);
+    for (n = 0; n < bfconf->n_filters; n++) {
+        changed = lock_fctrl_ints[2*n+0] != icomm->fctrl[n].coeff ||
+            lock_fctrl_ints[2*n+1] != icomm->fctrl[n].delayblocks;
+        offset = icomm->fctrl[n].scale[IN] - icomm->fctrl_scales;
+        count = bfconf->filters[n].n_channels[IN] +
+            bfconf->filters[n].n_channels[OUT] +
+            bfconf->filters[n].n_filters[IN];
+        for (i = offset; i < offset + count && !changed; i++) {
+            changed = lock_fctrl_scales[i] != icomm->fctrl_scales[i];
+        }
+        if (changed) {
+            icomm->fctrl_block[n] = last;
+        }
+    }
+}
+
+static int
+schedule_filter(unsigned int block_index,
+                int filter,
+                const struct bffilter_control *fctrl)
+{
+    volatile struct scheduled_filter *sf;
+    volatile double *scales;
+    uint32_t first, last;
+    bool_t unlock;
+    int n, i;
+
+    if (filter < 0 || filter >= bfconf->n_filters ||
+        fctrl->coeff < -1 || fctrl->coeff >= bfconf->n_coeffs ||
+        fctrl->delayblocks < 0 || fctrl->delayblocks > bfconf->n_blocks - 1)
+    {
+        return -1;
+    }
+    unlock = icomm_lock_if_unlocked();
+    blockcounter_range(&first, &last);
+    for (n = 0; n < SCHEDULE_QUEUE_SIZE && icomm->schedule[n].valid; n++);
+    /* the filter processes must not have started the block yet, and one may
+       start the next while we are here */
+    if (n == SCHEDULE_QUEUE_SIZE || (int32_t)(block_index - last) < 2) {
+        if (unlock) {
+            icomm_mutex(0);
+        }
+        return -1;
+    }
+    sf = &icomm->schedule[n];
+    sf->block = block_index;
+    sf->id = icomm->schedule_id++;
+    sf->filter = filter;
+    sf->coeff = fctrl->coeff;
+    sf->delayblocks = fctrl->delayblocks;
+    scales = &icomm->schedule_scales[n * schedule_stride];
+    FOR_IN_AND_OUT {
+        for (i = 0; i < bfconf->filters[filter].n_channels[IO]; i++) {
+            *scales++ = fctrl->scale[IO][i];
+        }
+    }
+    for (i = 0; i < bfconf->filters[filter].n_filters[IN]; i++) {
+        *scales++ = fctrl->fscale[i];
+    }
+    MEMORY_BARRIER();
+    sf->valid = 1;
+    icomm->n_scheduled++;
+    if (unlock) {
+        icomm_mutex(0);
+    }
+    return 0;
+}
+
+static unsigned int
+current_block(void)
+{
+    uint32_t first, last;
+
+    blockcounter_range(&first, &last);
+    return last;
+}
+
+/* The mutex is only taken by those that change the control data. Readers
+   (the filter processes) instead look at the sequence number, which is odd
+   while a change is in progress, and incremented again when done. */
 static void
 icomm_mutex(int lock)
 {
@@ -686,13 +1087,228 @@ icomm_mutex(int lock)
         if (!readfd(mutex_pipe[0], dummydata, 1)) {
             bf_exit(BF_EXIT_OTHER);
         }
+        icomm_is_locked = true;
+        icomm->ctrl_seq++;
+        MEMORY_BARRIER();
+        schedule_fold();
+        lock_snapshot();
     } else {
+        lock_mark_changed();
+        MEMORY_BARRIER();
+        icomm->ctrl_seq++;
+        icomm_is_locked = false;
         if (!writefd(mutex_pipe[1], dummydata, 1)) {
             bf_exit(BF_EXIT_OTHER);
         }
     }
 }
 
+struct control_copy {
+    uint32_t seq;
+    int n_filters;
+    struct bffilter *filters;
+    int n_channels[2];
+    int *channels[2];
+    int *ints;
+    double *reals;
+    /* scheduled changes due, staged like the rest */
+    int *filter_map;
+    int n_scheduled;
+    struct scheduled_filter *scheduled;
+    double *scheduled_scales;
+};
+
+static void
+control_copy_init(struct control_copy *cc,
+                  int n_filters,
+                  struct bffilter filters[],
+                  int n_procinputs,
+                  int procinputs[],
+                  int n_procoutputs,
+                  int procoutputs[])
+{
+    int n, n_reals;
+
+    cc->n_filters = n_filters;
+    cc->filters = filters;
+    cc->n_channels[IN] = n_procinputs;
+    cc->channels[IN] = procinputs;
+    cc->n_channels[OUT] = n_procoutputs;
+    cc->channels[OUT] = procoutputs;
+    for (n = n_reals = 0; n < n_filters; n++) {
+        n_reals += filters[n].n_channels[IN] + filters[n].n_channels[OUT] +
+            filters[n].n_filters[IN];
+    }
+    cc->ints = emalloc((2 * n_filters + 3 * (n_procinputs + n_procoutputs)) *
+                       sizeof(int));
+    cc->reals = emalloc((n_reals + 1) * sizeof(double));
+    cc->filter_map = emalloc(bfconf->n_filters * sizeof(int));
+    for (n = 0; n < bfconf->n_filters; n++) {
+        cc->filter_map[n] = -1;
+    }
+    for (n = 0; n < n_filters; n++) {
+        cc->filter_map[filters[n].intname] = n;
+    }
+    cc->n_scheduled = 0;
+    cc->scheduled = emalloc(SCHEDULE_QUEUE_SIZE *
+                            sizeof(struct scheduled_filter));
+    cc->scheduled_scales = emalloc(SCHEDULE_QUEUE_SIZE * schedule_stride *
+                                   sizeof(double));
+    /* make sure the first fetch will copy */
+    cc->seq = icomm->ctrl_seq - 2;
+}
+
+/* Stage the scheduled changes of the filters of this process that take effect
+   at 'block', or if 'all' is set, also those that took effect before it. */
+static void
+control_copy_collect(struct control_copy *cc,
+                     uint32_t block,
+                     bool_t all)
+{
+    volatile struct scheduled_filter *sf;
+    volatile double *src;
+    double *dst;
+    int n, i;
+
+    cc->n_scheduled = 0;
+    if (icomm->n_scheduled == 0) {
+        return;
+    }
+    for (n = 0; n < SCHEDULE_QUEUE_SIZE; n++) {
+        sf = &icomm->schedule[n];
+        if (!sf->valid || cc->filter_map[sf->filter] == -1 ||
+            (all ? (int32_t)(sf->block - block) > 0 : sf->block != block))
+        {
+            continue;
+        }
+        MEMORY_BARRIER();
+        cc->scheduled[cc->n_scheduled] = *sf;
+        src = &icomm->schedule_scales[n * schedule_stride];
+        dst = &cc->scheduled_scales[cc->n_scheduled * schedule_stride];
+        for (i = 0; i < schedule_stride; i++) {
+            dst[i] = src[i];
+        }
+        cc->n_scheduled++;
+    }
+}
+
+static void
+control_copy_apply(struct control_copy *cc,
+                   struct bffilter_control fctrl[])
+{
+    int order[SCHEDULE_QUEUE_SIZE];
+    struct scheduled_filter *sf;
+    int n;
+
+    for (n = 0; n < cc->n_scheduled; n++) {
+        order[n] = n;
+    }
+    schedule_sort(order, cc->n_scheduled, cc->scheduled);
+    for (n = 0; n < cc->n_scheduled; n++) {
+        sf = &cc->scheduled[order[n]];
+        /* an immediate change made after this one took effect wins */
+        if ((int32_t)(sf->block - icomm->fctrl_block[sf->filter]) > 0) {
+            schedule_apply(sf,
+                           &cc->scheduled_scales[order[n] * schedule_stride],
+                           &fctrl[cc->filter_map[sf->filter]]);
+        }
+    }
+    cc->n_scheduled = 0;
+}
+
+/* Copy the control data used by this process from shared memory, but only if
+   it has been changed since the last time. It is first copied to a staging
+   area, and if a writer has been active during the copy, the result is thrown
+   away and a new attempt is made next time. Scheduled changes are applied at
+   the given block in any case. Returns true if the local copy was updated. */
+static bool_t
+control_copy_fetch(struct control_copy *cc,
+                   uint32_t block,
+                   struct bffilter_control fctrl[],
+                   int *delay[2],
+                   int *subdelay[2],
+                   uint32_t *ismuted[2])
+{
+    volatile struct bffilter_control *src;
+    struct bffilter *filter;
+    uint32_t seq;
+    double *rp;
+    int n, i, *ip, ch;
+
+    seq = icomm->ctrl_seq;
+    if (seq == cc->seq || (seq & 1) != 0) {
+        control_copy_collect(cc, block, false);
+        control_copy_apply(cc, fctrl);
+        return false;
+    }
+    MEMORY_BARRIER();
+    ip = cc->ints;
+    rp = cc->reals;
+    for (n = 0; n < cc->n_filters; n++) {
+        filter = &cc->filters[n];
+        src = &icomm->fctrl[filter->intname];
+        *ip++ = src->coeff;
+        *ip++ = src->delayblocks;
+        for (i = 0; i < filter->n_channels[IN]; i++) {
+            *rp++ = src->scale[IN][i];
+        }
+        for (i = 0; i < filter->n_channels[OUT]; i++) {
+            *rp++ = src->scale[OUT][i];
+        }
+        for (i = 0; i < filter->n_filters[IN]; i++) {
+            *rp++ = src->fscale[i];
+        }
+    }
+    FOR_IN_AND_OUT {
+        for (n = 0; n < cc->n_channels[IO]; n++) {
+            ch = cc->channels[IO][n];
+            *ip++ = icomm->delay[IO][ch];
+            *ip++ = icomm->subdelay[IO][ch];
+            *ip++ = bit_isset_volatile(icomm->ismuted[IO], ch);
+        }
+    }
+    /* changes scheduled earlier may not yet be folded into the control data */
+    control_copy_collect(cc, block, true);
+    MEMORY_BARRIER();
+    if (icomm->ctrl_seq != seq) {
+        control_copy_collect(cc, block, false);
+        control_copy_apply(cc, fctrl);
+        return false;
+    }
+    cc->seq = seq;
+
+    ip = cc->ints;
+    rp = cc->reals;
+    for (n = 0; n < cc->n_filters; n++) {
+        filter = &cc->filters[n];
+        fctrl[n].coeff = *ip++;
+        fctrl[n].delayblocks = *ip++;
+        for (i = 0; i < filter->n_channels[IN]; i++) {
+            fctrl[n].scale[IN][i] = *rp++;
+        }
+        for (i = 0; i < filter->n_channels[OUT]; i++) {
+            fctrl[n].scale[OUT][i] = *rp++;
+        }
+        for (i = 0; i < filter->n_filters[IN]; i++) {
+            fctrl[n].fscale[i] = *rp++;
+        }
+    }
+    FOR_IN_AND_OUT {
+        for (n = 0; n < cc->n_channels[IO]; n++) {
+            ch = cc->channels[IO][n];
+            delay[IO][ch] = *ip++;
+            subdelay[IO][ch] = *ip++;
+            if (*ip++) {
+                bit_set(ismuted[IO], ch);
+            } else {
+                bit_clr(ismuted[IO], ch);
+            }
+        }
+    }
+    control_copy_apply(cc, fctrl);
+    return true;
+}
+
 static bool_t
 memiszero(void *buf,
           int size)
@@ -770,6 +1386,118 @@ test_silent(void *buf,
     return true;
 }
 
+/* Accumulate the peak and sum of squares of 'n_samples' samples. Four
+   independent accumulators are used so the compiler can vectorise the
+   loops. */
+static void
+meter_update(void *buf,
+             int n_samples,
+             int realsize,
+             double *peak,
+             double *sumsq)
+{
+    int n, count;
+    
+    count = n_samples & ~3;
+    if (realsize == 4) {
+        float *fbuf = (float *)buf, fp[4] = { 0, 0, 0, 0 };
+        float fs[4] = { 0, 0, 0, 0 };
+        float a0, a1, a2, a3;
+        
+        for (n = 0; n < count; n += 4) {
+            a0 = fabsf(fbuf[n+0]);
+            a1 = fabsf(fbuf[n+1]);
+            a2 = fabsf(fbuf[n+2]);
+            a3 = fabsf(fbuf[n+3]);
+            fp[0] = a0 > fp[0] ? a0 : fp[0];
+            fp[1] = a1 > fp[1] ? a1 : fp[1];
+            fp[2] = a2 > fp[2] ? a2 : fp[2];
+            fp[3] = a3 > fp[3] ? a3 : fp[3];
+            fs[0] += a0 * a0;
+            fs[1] += a1 * a1;
+            fs[2] += a2 * a2;
+            fs[3] += a3 * a3;
+        }
+        for (; n < n_samples; n++) {
+            a0 = fabsf(fbuf[n]);
+            fp[0] = a0 > fp[0] ? a0 : fp[0];
+            fs[0] += a0 * a0;
+        }
+        for (n = 0; n < 4; n++) {
+            if (fp[n] > *peak) {
+                *peak = fp[n];
+            }
+            *sumsq += fs[n];
+        }
+    } else {
+        double *dbuf = (double *)buf, dp[4] = { 0, 0, 0, 0 };
+        double ds[4] = { 0, 0, 0, 0 };
+        double a0, a1, a2, a3;
+        
+        for (n = 0; n < count; n += 4) {
+            a0 = fabs(dbuf[n+0]);
+            a1 = fabs(dbuf[n+1]);
+            a2 = fabs(dbuf[n+2]);
+            a3 = fabs(dbuf[n+3]);
+            dp[0] = a0 > dp[0] ? a0 : dp[0];
+            dp[1] = a1 > dp[1] ? a1 : dp[1];
+            dp[2] = a2 > dp[2] ? a2 : dp[2];
+            dp[3] = a3 > dp[3] ? a3 : dp[3];
+            ds[0] += a0 * a0;
+            ds[1] += a1 * a1;
+            ds[2] += a2 * a2;
+            ds[3] += a3 * a3;
+        }
+        for (; n < n_samples; n++) {
+            a0 = fabs(dbuf[n]);
+            dp[0] = a0 > dp[0] ? a0 : dp[0];
+            ds[0] += a0 * a0;
+        }
+        for (n = 0; n < 4; n++) {
+            if (dp[n] > *peak) {
+                *peak = dp[n];
+            }
+            *sumsq += ds[n];
+        }
+    }
+}
+
+/* Write the levels of the channels of this filter process to the meter ring,
+   and reset the accumulators. */
+static void
+meter_publish(int process_index,
+              int n_procinputs,
+              int procinputs[],
+              int n_procoutputs,
+              int procoutputs[],
+              double peak[],
+              double sumsq[],
+              double scale[],
+              int n_samples)
+{
+    volatile struct bflevel *slot;
+    uint32_t frame;
+    int n, i;
+
+    frame = icomm->meter_frame[process_index];
+    slot = &icomm->meter_ring[(frame % METER_RING_SIZE) *
+                              (bfconf->n_channels[IN] +
+                               bfconf->n_channels[OUT])];
+    for (n = 0; n < n_procinputs + n_procoutputs; n++) {
+        if (n < n_procinputs) {
+            i = procinputs[n];
+        } else {
+            i = bfconf->n_channels[IN] + procoutputs[n - n_procinputs];
+        }
+        slot[i].peak = (float)(peak[n] * scale[n]);
+        slot[i].rms = (float)(sqrt(sumsq[n] / (double)n_samples) * scale[n]);
+        peak[n] = 0;
+        sumsq[n] = 0;
+    }
+    MEMORY_BARRIER();
+    icomm->meter_frame[process_index] = frame + 1;
+}
+
 static void
 input_process(void *buf[2],
 	      int filter_writefd,
@@ -836,12 +1564,37 @@ input_process(void *buf[2],
             sched_yield();
         }
         timestamp(&icomm->debug.i[dbg_pos].w_filter.ts_ret);
-        if (++dbg_pos == DEBUG_RING_BUFFER_SIZE) {
+        if (++dbg_pos == debug_ring_size) {
             dbg_pos = 0;
         }
     }
 }
 
+/* Called when all filter processes have finished their initialisation. */
+static void
+print_shm_usage(void)
+{
+    size_t total, hugetlb, thp;
+    int n;
+
+    if (!bfconf->hugepages) {
+        return;
+    }
+    total = icomm->shm_usage_main.total;
+    hugetlb = icomm->shm_usage_main.hugetlb;
+    thp = icomm->shm_usage_main.thp;
+    for (n = 0; n < bfconf->n_processes; n++) {
+        total += icomm->shm_usage[n].total;
+        hugetlb += icomm->shm_usage[n].hugetlb;
+        thp += icomm->shm_usage[n].thp;
+    }
+    pinfo("Shared memory: %.1f MB, %.1f MB on huge pages, %.1f MB on "
+          "transparent huge pages (advised).\n",
+          (double)total / (1024.0 * 1024.0),
+          (double)hugetlb / (1024.0 * 1024.0),
+          (double)thp / (1024.0 * 1024.0));
+}
+
 static void
 output_process(int filter_readfd,
 	       int synch_readfd,
@@ -866,9 +1619,11 @@ output_process(int filter_readfd,
         }
     }
     /* verify if we need to write iodelay output */
+    print_shm_usage();
     if (bfconf->synched_write) {
         pinfo("Fixed I/O-delay is %d samples\n"
               "Audio processing starts now\n", 2 * bfconf->filter_length +
+            (bfconf->pipelined ? bfconf->filter_length : 0) +
             (bfconf->use_subdelay[IN] ? bfconf->sdf_length : 0) +
             (bfconf->use_subdelay[OUT] ? bfconf->sdf_length : 0));
         if (trigger_callback_io) {
@@ -948,13 +1703,13 @@ output_process(int filter_readfd,
         
 	bufindex++;
 
-        if (++dbg_pos == DEBUG_RING_BUFFER_SIZE) {
+        if (++dbg_pos == debug_ring_size) {
             dbg_pos = 0;
         }
         icomm->debug.periods++;
 
         if (bfconf->debug &&
-            icomm->debug.periods == DEBUG_RING_BUFFER_SIZE - 4)
+            icomm->debug.periods == debug_ring_size - 4)
         {
             fprintf(stderr, "Debug timestamp buffer is now full, exiting\n");
             bf_exit(BF_EXIT_OTHER);
@@ -965,6 +1720,8 @@ output_process(int filter_readfd,
 struct apply_subdelay_params {
     int subdelay;
     void *rest;    
+    vardelay_t *vd;
+    int delay;
 };
 
 static void
@@ -976,12 +1733,32 @@ apply_subdelay(void *realbuf,
 
     p = (struct apply_subdelay_params *)arg;
 
+    if (p->vd != NULL) {
+        delay_vardelay_update(p->vd, realbuf, p->delay);
+    }
     if (p->rest == NULL) {
         return;
     }
     delay_subsample_update(realbuf, p->rest, p->subdelay);
 }
 
+static void
+apply_freqd_subdelay(void *cbuf,
+                     void *ramp,
+                     int *ramp_subdelay,
+                     int subdelay)
+{
+    if (subdelay == 0) {
+        return;
+    }
+    if (subdelay != *ramp_subdelay) {
+        convolver_subdelay2cbuf((double)subdelay / (double)BF_SAMPLE_SLOTS,
+                                ramp);
+        *ramp_subdelay = subdelay;
+    }
+    convolver_convolve_inplace(cbuf, ramp);
+}
+
 static void
 synch_filter_processes(int filter_readfd,
                        int filter_writefd[],
@@ -1004,12 +1781,242 @@ synch_filter_processes(int filter_readfd,
     }
 }
 
+/* Fault in the pages of a memory area without copying its contents. If 'lock'
+   is set the pages are locked as well, which faults them in as a side
+   effect. Returns false if locking was requested but failed, the pages are
+   faulted in anyway. */
+static bool_t
+prefault_memory(void *p,
+                size_t size,
+                bool_t lock)
+{
+    uint8_t *start, *end;
+    long pagesize;
+
+    pagesize = sysconf(_SC_PAGESIZE);
+    start = (uint8_t *)((ptrdiff_t)p & ~(ptrdiff_t)(pagesize - 1));
+    end = (uint8_t *)p + size;
+    if (lock) {
+        if (mlock(start, end - start) == 0) {
+            return true;
+        }
+        lock = false;
+    } else {
+        lock = true;
+    }
+#ifdef MADV_POPULATE_READ
+    if (madvise(start, end - start, MADV_POPULATE_READ) == 0) {
+        return lock;
+    }
+#endif
+    for (; start < end; start += pagesize) {
+        (void)*(volatile uint8_t *)start;
+    }
+    return lock;
+}
+
+/* Load a coefficient set into 'dest' in a child process, so a broken
+   coefficient file does not take the loader down with it. */
+static bool_t
+load_coeff_child(int c,
+                 const char filename[],
+                 uint8_t *dest)
+{
+    int status;
+    pid_t pid;
+
+    switch (pid = fork()) {
+    case 0:
+        bfconf_load_coeff(c, filename, dest);
+        _exit(0);
+    case -1:
+        fprintf(stderr, "Fork failed: %s.\n", strerror(errno));
+        return false;
+    default:
+        break;
+    }
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Failed to load coeff %d.\n", c);
+        return false;
+    }
+    return true;
+}
+
+/* Runtime loading of coefficients, in a process of its own.
+
+   Lazily loaded coefficient sets are loaded when they are selected, into a
+   fixed number of slots. When all slots are taken, the least recently used
+   set that no filter has pinned, and that has not been selected or used for
+   a second, is evicted. Sets that failed to load are tried again every few
+   seconds as long as they are selected.
+
+   Reloaded coefficient sets are loaded into the spare block area of the set,
+   and the block pointers are then swapped, which the filters pick up at the
+   next block boundary. The old area is not reused until a second after the
+   swap, so filters crossfading from it are long done with it.
+
+   The process sleeps on a pipe which is written to when a reload is
+   requested, and by the filter processes when they find a selected set not
+   loaded. While there is work that had to be put off it polls. */
+static void
+coeff_loader_process(void)
+{
+    int n, c, slot, blocksize, n_slots, slot_owner[bfconf->n_lazy_slots + 1];
+    struct timeval last_used[bfconf->n_lazy_slots + 1], tv, tv2;
+    struct timeval swapped[bfconf->n_coeffs], failed[bfconf->n_coeffs];
+    bool_t wanted[bfconf->n_coeffs], used[bfconf->n_coeffs], pending;
+    char *filenames[bfconf->n_coeffs];
+    char dummy[64];
+    struct pollfd pfd;
+    void **cdata;
+    uint8_t *dest;
+
+    blocksize = convolver_cbufsize() + bfconf->stagger_size;
+    n_slots = bfconf->n_lazy_slots;
+    for (n = 0; n < n_slots; n++) {
+        slot_owner[n] = -1;
+        timerclear(&last_used[n]);
+    }
+    for (n = 0; n < bfconf->n_coeffs; n++) {
+        timerclear(&swapped[n]);
+        timerclear(&failed[n]);
+        filenames[n] = NULL;
+    }
+    close(loader_pipe[1]);
+    pfd.fd = loader_pipe[0];
+    pfd.events = POLLIN;
+    pending = true;
+    while (true) {
+        if (poll(&pfd, 1, pending ? 100 : -1) == -1 && errno != EINTR) {
+            fprintf(stderr, "Coefficient loader poll failed: %s.\n",
+                    strerror(errno));
+            bf_exit(BF_EXIT_OTHER);
+        }
+        if ((pfd.revents & POLLIN) != 0) {
+            (void)!read(loader_pipe[0], dummy, sizeof(dummy));
+        }
+        pending = false;
+        gettimeofday(&tv, NULL);
+
+        if ((c = icomm->reload.coeff) != -1) {
+            timersub(&tv, &swapped[c], &tv2);
+            if (tv2.tv_sec >= 1) {
+                if (icomm->reload.filename[0] != '\0') {
+                    efree(filenames[c]);
+                    filenames[c] = estrdup((char *)icomm->reload.filename);
+                }
+                cdata = bfconf->coeffs_spare[c];
+                if (load_coeff_child(c, filenames[c], (uint8_t *)cdata[0])) {
+                    MEMORY_BARRIER();
+                    bfconf->coeffs_spare[c] = bfconf->coeffs_data[c];
+                    bfconf->coeffs_data[c] = cdata;
+                    gettimeofday(&swapped[c], NULL);
+                }
+                icomm->reload.coeff = -1;
+            } else {
+                pending = true;
+            }
+        }
+
+        if (bfconf->coeff_state == NULL) {
+            continue;
+        }
+        memset(wanted, 0, sizeof(wanted));
+        memset(used, 0, sizeof(used));
+        for (n = 0; n < bfconf->n_filters; n++) {
+            if ((c = icomm->fctrl[n].coeff) >= 0 && c < bfconf->n_coeffs) {
+                wanted[c] = true;
+            }
+            if ((c = icomm->used_coeff[n]) >= 0 && c < bfconf->n_coeffs) {
+                used[c] = true;
+            }
+        }
+        for (n = 0; n < n_slots; n++) {
+            if (slot_owner[n] != -1 &&
+                (wanted[slot_owner[n]] || used[slot_owner[n]] ||
+                 icomm->coeff_pins[slot_owner[n]] != 0))
+            {
+                last_used[n] = tv;
+            }
+        }
+        for (c = 0; c < bfconf->n_coeffs; c++) {
+            if (!wanted[c]) {
+                continue;
+            }
+            if (bfconf->coeff_state[c] == BF_COEFF_FAILED) {
+                timersub(&tv, &failed[c], &tv2);
+                if (tv2.tv_sec < 5) {
+                    pending = true;
+                    continue;
+                }
+            } else if (bfconf->coeff_state[c] != BF_COEFF_UNLOADED) {
+                continue;
+            }
+            /* find a free slot, or the least recently used idle one */
+            for (n = 0, slot = -1; n < n_slots; n++) {
+                if (slot_owner[n] == -1) {
+                    slot = n;
+                    break;
+                }
+                if (wanted[slot_owner[n]] || used[slot_owner[n]] ||
+                    icomm->coeff_pins[slot_owner[n]] != 0)
+                {
+                    continue;
+                }
+                timersub(&tv, &last_used[n], &tv2);
+                if (tv2.tv_sec < 1) {
+                    continue;
+                }
+                if (slot == -1 || timercmp(&last_used[n], &last_used[slot], <))
+                {
+                    slot = n;
+                }
+            }
+            if (slot == -1) {
+                /* try again when a slot has been idle for long enough */
+                pending = true;
+                break;
+            }
+            if (slot_owner[slot] != -1) {
+                /* a filter process pins the set before it checks the state,
+                   so if it is still unpinned after the state has been
+                   changed, no filter can start using it */
+                n = slot_owner[slot];
+                bfconf->coeff_state[n] = BF_COEFF_UNLOADED;
+                MEMORY_BARRIER();
+                if (icomm->coeff_pins[n] != 0) {
+                    bfconf->coeff_state[n] = BF_COEFF_READY;
+                    last_used[slot] = tv;
+                    pending = true;
+                    break;
+                }
+                slot_owner[slot] = -1;
+            }
+            dest = &bfconf->lazy_slots[slot * bfconf->lazy_slot_size];
+            if (!load_coeff_child(c, NULL, dest)) {
+                bfconf->coeff_state[c] = BF_COEFF_FAILED;
+                gettimeofday(&failed[c], NULL);
+                pending = true;
+                continue;
+            }
+            for (n = 0; n < bfconf->coeffs[c].n_blocks; n++) {
+                bfconf->coeffs_data[c][n] = &dest[n * blocksize];
+            }
+            MEMORY_BARRIER();
+            bfconf->coeff_state[c] = BF_COEFF_READY;
+            slot_owner[slot] = c;
+            last_used[slot] = tv;
+        }
+    }
+}
+
 static void
 filter_process(struct bfaccess *bfaccess,
                void *inbuf[2],
 	       void *outbuf[2],
-	       void *input_freqcbuf[],
-	       void *output_freqcbuf[],
+	       void **input_freqcbufs[2],
+	       void **output_freqcbufs[2],
 	       int filter_readfd,
 	       int filter_writefd[],
 	       int input_readfd,
@@ -1037,9 +2044,13 @@ filter_process(struct bfaccess *bfaccess,
     int n_blocks = bfconf->n_blocks;
     int curblock = 0;
     int curbuf = 0;
+    int curspec = 0;
+    int prevspec = 0;
     
     void *input_timecbuf[n_procinputs][2];
-    void **mixconvbuf_inputs[n_filters];
+    void **input_freqcbuf = input_freqcbufs[0];
+    void **output_freqcbuf = output_freqcbufs[0];
+    void **mixconvbuf_inputs[2][n_filters];
     void **mixconvbuf_filters[n_filters];
     void *cbuf[n_filters][n_blocks];
     void *ocbuf[n_filters];
@@ -1047,18 +2058,24 @@ filter_process(struct bfaccess *bfaccess,
     void *static_evalbuf = NULL;
     void *inbuf_copy = NULL;
     
-    double *outscale[BF_MAXCHANNELS][n_filters];
-    double scales[n_filters + BF_MAXCHANNELS];
-    double virtscales[2][BF_MAXCHANNELS];
+    double *outscale[n_outputs][n_filters];
+    double scales[n_filters + bfconf->n_channels[IN] + 1];
+    double *virtscales[2];
     void *crossfadebuf[2];
     void *mixbuf = NULL;
-    void *outconvbuf[BF_MAXCHANNELS][n_filters];
-    int outconvbuf_n_filters[BF_MAXCHANNELS];
+    void *outconvbuf[n_outputs][n_filters];
+    int outconvbuf_n_filters[n_outputs];
     unsigned int blockcounter = 0;
-    delaybuffer_t *output_db[BF_MAXCHANNELS];
-    delaybuffer_t *input_db[BF_MAXCHANNELS];
-    void *output_sd_rest[BF_MAXCHANNELS];
-    void *input_sd_rest[BF_MAXCHANNELS];
+    delaybuffer_t *output_db[bfconf->n_channels[OUT]];
+    delaybuffer_t *input_db[bfconf->n_channels[IN]];
+    void *output_sd_rest[bfconf->n_channels[OUT]];
+    void *input_sd_rest[bfconf->n_channels[IN]];
+    vardelay_t *output_vd[bfconf->n_channels[OUT]];
+    vardelay_t *input_vd[bfconf->n_channels[IN]];
+    void *output_sd_ramp[bfconf->n_channels[OUT]];
+    void *input_sd_ramp[bfconf->n_channels[IN]];
+    int output_sd_ramp_subdelay[bfconf->n_channels[OUT]];
+    int input_sd_ramp_subdelay[bfconf->n_channels[IN]];
     bool_t need_crossfadebuf = false;
     bool_t need_mixbuf = false;
     bool_t mixbuf_is_filled;
@@ -1068,29 +2085,40 @@ filter_process(struct bfaccess *bfaccess,
     struct buffer_format *bf, inbuf_copy_bf;
     uint8_t *memptr, *baseptr;
     struct bfoverflow of;
-    uint32_t dummydata32;
+    int progress, k;
+    bool_t lock, lock_ok, show_progress;
+    char coeff_owner[bfconf->n_coeffs + 1];
     char dummydata[1];
 
-    int memsize, icomm_delay[2][BF_MAXCHANNELS];
+    int memsize, stagger, *icomm_delay[2];
+    size_t shm[6];
     struct bffilter_control icomm_fctrl[n_filters];
-    uint32_t icomm_ismuted[2][BF_MAXCHANNELS/32];
+    uint32_t *icomm_ismuted[2];
     bool_t powersave, change_prio, first_print;
-    int icomm_subdelay[2][BF_MAXCHANNELS];
+    int *icomm_subdelay[2];
     struct apply_subdelay_params sd_params;
-    int dbg_pos, subdelay_fb_size;
+    struct control_copy ctrl;
+    int dbg_pos, subdelay_fb_size, ramp_length;
 
     int prevcoeff[n_filters];
+    int waitcoeff[n_filters];
+    void **prevcdata[n_filters], **cdata;
+    bool_t changed;
     int procblocks[n_filters];
     uint32_t partial_proc[n_filters / 32 + 1];
     int *mixconvbuf_filters_map[n_filters];
-    int outconvbuf_map[BF_MAXCHANNELS][n_filters];
-    bool_t input_freqcbuf_zero[bfconf->n_channels[IN]];
-    bool_t output_freqcbuf_zero[bfconf->n_channels[OUT]];
+    int outconvbuf_map[n_outputs][n_filters];
+    bool_t input_freqcbuf_zero[2][bfconf->n_channels[IN]];
+    bool_t output_freqcbuf_zero[2][bfconf->n_channels[OUT]];
     bool_t cbuf_zero[n_filters][n_blocks];
     bool_t ocbuf_zero[n_filters];
     bool_t evalbuf_zero[n_filters];
     bool_t temp_buffer_zero;
     bool_t iszero;    
+    double meter_peak[n_procinputs + n_procoutputs + 1];
+    double meter_sumsq[n_procinputs + n_procoutputs + 1];
+    double meter_scale[n_procinputs + n_procoutputs + 1];
+    int meter_blocks, meter_count;
     
     struct timeval period_start, period_end, tv;
     int32_t period_length;
@@ -1109,16 +2137,60 @@ filter_process(struct bfaccess *bfaccess,
     }
 
     subdelay_fb_size = delay_subsample_filterblocksize();
+    ramp_length = (int)(bfconf->delay_ramp * (double)bfconf->sampling_rate /
+                        1000.0);
     temp_buffer_zero = false;
+
+    /* levels are measured over a whole number of blocks */
+    meter_blocks = 0;
+    if (bfconf->meter_rate > 0) {
+        meter_blocks = (int)((double)bfconf->sampling_rate /
+                             (bfconf->meter_rate * (double)fragsize) + 0.5);
+        if (meter_blocks < 1) {
+            meter_blocks = 1;
+        }
+    }
+    meter_count = 0;
+    for (n = 0; n < n_procinputs + n_procoutputs; n++) {
+        if (n < n_procinputs) {
+            physch = bfconf->virt2phys[IN][procinputs[n]];
+            meter_scale[n] = dai_buffer_format[IN]->bf[physch].sf.scale;
+        } else {
+            physch = bfconf->virt2phys[OUT][procoutputs[n - n_procinputs]];
+            meter_scale[n] = dai_buffer_format[OUT]->bf[physch].sf.scale;
+        }
+        meter_peak[n] = 0;
+        meter_sumsq[n] = 0;
+    }
     memset(procblocks, 0, n_filters * sizeof(int));
     memset(partial_proc, 0xFF, (n_filters / 32 + 1) * sizeof(uint32_t));
     memset(evalbuf_zero, 0, n_filters * sizeof(bool_t));
     memset(ocbuf_zero, 0, n_filters * sizeof(bool_t));
     memset(cbuf_zero, 0, n_blocks * n_filters * sizeof(bool_t));
-    memset(output_freqcbuf_zero, 0, bfconf->n_channels[OUT] * sizeof(bool_t));
-    memset(input_freqcbuf_zero, 0, bfconf->n_channels[IN] * sizeof(bool_t));
+    memset(output_freqcbuf_zero, 0, sizeof(output_freqcbuf_zero));
+    memset(input_freqcbuf_zero, 0, sizeof(input_freqcbuf_zero));
     memset(crossfadebuf, 0, sizeof(crossfadebuf));
-    memset(icomm_subdelay, 0, sizeof(icomm_subdelay));
+
+    /* local copies of control data, with space only for what is used */
+    FOR_IN_AND_OUT {
+        icomm_delay[IO] = emalloc(bfconf->n_channels[IO] * sizeof(int));
+        memset(icomm_delay[IO], 0, bfconf->n_channels[IO] * sizeof(int));
+        icomm_subdelay[IO] = emalloc(bfconf->n_channels[IO] * sizeof(int));
+        memset(icomm_subdelay[IO], 0, bfconf->n_channels[IO] * sizeof(int));
+        icomm_ismuted[IO] = emalloc((bfconf->n_channels[IO] / 32 + 1) *
+                                    sizeof(uint32_t));
+        memset(icomm_ismuted[IO], 0, (bfconf->n_channels[IO] / 32 + 1) *
+               sizeof(uint32_t));
+        virtscales[IO] = emalloc(bfconf->n_channels[IO] * sizeof(double));
+    }
+    for (n = 0; n < n_filters; n++) {
+        FOR_IN_AND_OUT {
+            icomm_fctrl[n].scale[IO] =
+                emalloc((filters[n].n_channels[IO] + 1) * sizeof(double));
+        }
+        icomm_fctrl[n].fscale =
+            emalloc((filters[n].n_filters[IN] + 1) * sizeof(double));
+    }
 
     if (!readfd(input_readfd, dummydata, 1)) { /* for init */
         bf_exit(BF_EXIT_OTHER);
@@ -1129,15 +2201,36 @@ filter_process(struct bfaccess *bfaccess,
     for (n = j = 0; n < n_procinputs; n++) {
 	virtch = procinputs[n];
 	physch = bfconf->virt2phys[IN][virtch];
+        input_sd_rest[virtch] = NULL;
+        input_sd_ramp[virtch] = NULL;
+        input_sd_ramp_subdelay[virtch] = 0;
         if (bfconf->use_subdelay[IN] &&
             bfconf->subdelay[IN][virtch] != BF_UNDEFINED_SUBDELAY)
         {
-            input_sd_rest[virtch] =
-                emallocaligned(subdelay_fb_size * bfconf->realsize);
-            memset(input_sd_rest[virtch], 0,
-                   subdelay_fb_size * bfconf->realsize);
-        } else {
-            input_sd_rest[virtch] = NULL;
+            if (bfconf->freqd_subdelay) {
+                input_sd_ramp[virtch] = emallocaligned(convbufsize);
+            } else {
+                input_sd_rest[virtch] =
+                    emallocaligned(subdelay_fb_size * bfconf->realsize);
+                memset(input_sd_rest[virtch], 0,
+                       subdelay_fb_size * bfconf->realsize);
+            }
+        }
+        delay = 0;
+        if (bfconf->use_subdelay[IN] &&
+            bfconf->subdelay[IN][virtch] == BF_UNDEFINED_SUBDELAY)
+        {
+            delay = bfconf->sdf_length;
+        }
+        input_vd[virtch] = NULL;
+        if (bfconf->delay_ramp > 0) {
+            /* all delays are ramped here, after conversion */
+            input_vd[virtch] =
+                delay_vardelay_new(fragsize,
+                                   icomm->delay[IN][virtch] + delay,
+                                   bfconf->maxdelay[IN][virtch] < 0 ? -1 :
+                                   bfconf->maxdelay[IN][virtch] + delay,
+                                   ramp_length, bfconf->realsize);
         }
 	if (bfconf->n_virtperphys[IN][physch] > 1) {
 	    for (i = 0; i < bfconf->n_subdevs[IN]; i++) {
@@ -1148,17 +2241,20 @@ filter_process(struct bfaccess *bfaccess,
 		    break;
 		}
 	    }
-            delay = 0;
-            if (bfconf->use_subdelay[IN] &&
-                bfconf->subdelay[IN][virtch] == BF_UNDEFINED_SUBDELAY)
-            {
-                delay = bfconf->sdf_length;
+            if (input_vd[virtch] != NULL) {
+                /* only used to copy the channel, without delay */
+                input_db[virtch] =
+                    delay_allocate_buffer(fragsize, 0, -1,
+                                          bfconf->subdevs[IN][i].
+                                          channels.sf.bytes);
+            } else {
+                input_db[virtch] =
+                    delay_allocate_buffer(fragsize,
+                                          icomm->delay[IN][virtch] + delay,
+                                          bfconf->maxdelay[IN][virtch] + delay,
+                                          bfconf->subdevs[IN][i].
+                                          channels.sf.bytes);
             }
-	    input_db[virtch] =
-		delay_allocate_buffer(fragsize,
-				      icomm->delay[IN][virtch] + delay,
-				      bfconf->maxdelay[IN][virtch] + delay,
-				      bfconf->subdevs[IN][i].channels.sf.bytes);
 	    if (bfconf->subdevs[IN][i].channels.sf.bytes > j) {
 		j = bfconf->subdevs[IN][i].channels.sf.bytes;
 	    }
@@ -1176,31 +2272,45 @@ filter_process(struct bfaccess *bfaccess,
     for (n = 0; n < n_procoutputs; n++) {
 	virtch = procoutputs[n];
 	physch = bfconf->virt2phys[OUT][virtch];
+        output_sd_rest[virtch] = NULL;
+        output_sd_ramp[virtch] = NULL;
+        output_sd_ramp_subdelay[virtch] = 0;
         if (bfconf->use_subdelay[OUT] &&
             bfconf->subdelay[OUT][virtch] != BF_UNDEFINED_SUBDELAY)
         {
-            output_sd_rest[virtch] =
-                emallocaligned(subdelay_fb_size * bfconf->realsize);
-            memset(output_sd_rest[virtch], 0,
-                   subdelay_fb_size * bfconf->realsize);
-        } else {
-            output_sd_rest[virtch] = NULL;
-        }
-	if (bfconf->n_virtperphys[OUT][physch] > 1) {
-            delay = 0;
-            if (bfconf->use_subdelay[OUT] &&
-                bfconf->subdelay[OUT][virtch] == BF_UNDEFINED_SUBDELAY)
-            {
-                delay = bfconf->sdf_length;
+            if (bfconf->freqd_subdelay) {
+                output_sd_ramp[virtch] = emallocaligned(convbufsize);
+            } else {
+                output_sd_rest[virtch] =
+                    emallocaligned(subdelay_fb_size * bfconf->realsize);
+                memset(output_sd_rest[virtch], 0,
+                       subdelay_fb_size * bfconf->realsize);
             }
+        }
+        delay = 0;
+        if (bfconf->use_subdelay[OUT] &&
+            bfconf->subdelay[OUT][virtch] == BF_UNDEFINED_SUBDELAY)
+        {
+            delay = bfconf->sdf_length;
+        }
+        output_vd[virtch] = NULL;
+        output_db[virtch] = NULL;
+        if (bfconf->delay_ramp > 0) {
+            output_vd[virtch] =
+                delay_vardelay_new(fragsize,
+                                   icomm->delay[OUT][virtch] + delay,
+                                   bfconf->maxdelay[OUT][virtch] < 0 ? -1 :
+                                   bfconf->maxdelay[OUT][virtch] + delay,
+                                   ramp_length, bfconf->realsize);
+        } else if (bfconf->n_virtperphys[OUT][physch] > 1) {
 	    output_db[virtch] =
 		delay_allocate_buffer(fragsize,
 				      icomm->delay[OUT][virtch] + delay,
 				      bfconf->maxdelay[OUT][virtch] + delay,
 				      bfconf->realsize);
+	}
+	if (bfconf->n_virtperphys[OUT][physch] > 1) {
 	    need_mixbuf = true;
-	} else {
-	    output_db[virtch] = NULL;
 	}
     }
     
@@ -1216,6 +2326,7 @@ filter_process(struct bfaccess *bfaccess,
     }
 
     /* allocate input/output/evaluation convolve buffers */
+    stagger = bfconf->stagger_size;
     if (inbuf_copy_size > convbufsize) {
 	/* this should never happen, since convbufsize should be
 	   2 * fragsize * realsize, sample sizes should never exceed
@@ -1233,6 +2344,15 @@ filter_process(struct bfaccess *bfaccess,
 	    i * (convbufsize + convbufsize / 2) +
 	    2 * n_procinputs * convbufsize;
     }
+    /* stagger the buffers to avoid cache set aliasing, the filter process
+       buffers are the third buffer stream */
+    if (n_blocks > 1) {
+        memsize += (n_filters * n_blocks + n_filters + i + n_procinputs) *
+            stagger + 2 * bfconf->stagger_offset;
+    } else {
+        memsize += (n_filters + i + n_procinputs) * stagger +
+            2 * bfconf->stagger_offset;
+    }
     if (i > 0) {
         memsize += convbufsize;
         if (need_crossfadebuf) {
@@ -1245,7 +2365,19 @@ filter_process(struct bfaccess *bfaccess,
             memsize += fragsize * bfconf->realsize;
         }
     }
-    memptr = emallocaligned(memsize);
+    if (bfconf->hugepages) {
+        /* the counters are inherited from the parent, only add our own */
+        shmalloc_usage(&shm[0], &shm[1], &shm[2]);
+        if ((memptr = shmalloc(memsize)) == NULL) {
+            bf_exit(BF_EXIT_NO_MEMORY);
+        }
+        shmalloc_usage(&shm[3], &shm[4], &shm[5]);
+        icomm->shm_usage[process_index].total = shm[3] - shm[0];
+        icomm->shm_usage[process_index].hugetlb = shm[4] - shm[1];
+        icomm->shm_usage[process_index].thp = shm[5] - shm[2];
+    } else {
+        memptr = emallocaligned(memsize);
+    }
     baseptr = memptr;
     if (i > 0) {
         if (need_crossfadebuf) {
@@ -1269,60 +2401,69 @@ filter_process(struct bfaccess *bfaccess,
             mixbuf = memptr + memsize - fragsize * bfconf->realsize;
         }
     }
+    memptr += 2 * bfconf->stagger_offset;
     if (n_blocks > 1) {
         for (n = 0; n < n_filters; n++) {
 	    for (i = 0; i < n_blocks; i++) {
 		cbuf[n][i] = memptr;
-		memptr += convbufsize;
+		memptr += convbufsize + stagger;
 	    }
 	    if (filters[n].n_filters[IN] > 0) {
 		evalbuf[n] = memptr;
-		memptr += (convbufsize + convbufsize / 2);
+		memptr += (convbufsize + convbufsize / 2) + stagger;
 	    } else {
 		evalbuf[n] = NULL;
 	    }
 	    ocbuf[n] = memptr;
-	    memptr += convbufsize;
+	    memptr += convbufsize + stagger;
 	}
     } else {
 	for (n = 0; n < n_filters; n++) {
 	    cbuf[n][0] = ocbuf[n] = memptr;
-	    memptr += convbufsize;
+	    memptr += convbufsize + stagger;
 	    if (filters[n].n_filters[IN] > 0) {
 		evalbuf[n] = memptr;
-		memptr += (convbufsize + convbufsize / 2);
+		memptr += (convbufsize + convbufsize / 2) + stagger;
 	    } else {
 		evalbuf[n] = NULL;
 	    }
 	}
     }
     inbuf_copy = ocbuf[0];
-    for (n = 0; n < n_procinputs; n++, memptr += 2 * convbufsize) {
+    for (n = 0; n < n_procinputs; n++, memptr += 2 * convbufsize + stagger) {
 	input_timecbuf[n][0] = memptr;
 	input_timecbuf[n][1] = memptr + convbufsize;
     }
-    /* for each filter, find out which channel-inputs that are mixed */
-    for (n = 0; n < n_filters; n++) {
-	if (filters[n].n_filters[IN] > 0) {
-	    /* allocate extra position for filter-input evaluation buffer */
-	    mixconvbuf_inputs[n] =
-		alloca((filters[n].n_channels[IN] + 1) * sizeof(void **));
-	    mixconvbuf_inputs[n][filters[n].n_channels[IN]] = NULL;
-	} else if (filters[n].n_channels[IN] == 0) {
-	    mixconvbuf_inputs[n] = NULL;
-	    continue;
-	} else {
-	    mixconvbuf_inputs[n] =
-		alloca(filters[n].n_channels[IN] * sizeof(void **));
-	}
-	for (i = 0; i < filters[n].n_channels[IN]; i++) {
-	    mixconvbuf_inputs[n][i] =
-		input_freqcbuf[filters[n].channels[IN][i]];
-	}
+    /* for each filter, find out which channel-inputs that are mixed. In
+       pipelined mode there are two sets of input spectra, so the lists are
+       made for both */
+    for (j = 0; j < 2; j++) {
+        for (n = 0; n < n_filters; n++) {
+            if (filters[n].n_filters[IN] > 0) {
+                /* allocate extra position for filter-input evaluation
+                   buffer */
+                mixconvbuf_inputs[j][n] =
+                    alloca((filters[n].n_channels[IN] + 1) * sizeof(void **));
+                mixconvbuf_inputs[j][n][filters[n].n_channels[IN]] = NULL;
+            } else if (filters[n].n_channels[IN] == 0) {
+                mixconvbuf_inputs[j][n] = NULL;
+                continue;
+            } else {
+                mixconvbuf_inputs[j][n] =
+                    alloca(filters[n].n_channels[IN] * sizeof(void **));
+            }
+            for (i = 0; i < filters[n].n_channels[IN]; i++) {
+                mixconvbuf_inputs[j][n][i] =
+                    input_freqcbufs[j][filters[n].channels[IN][i]];
+            }
+        }
     }
     /* for each filter, find out which filter-inputs that are mixed */
     for (n = 0; n < n_filters; n++) {
         prevcoeff[n] = icomm->fctrl[filters[n].intname].coeff;
+        waitcoeff[n] = -1;
+        prevcdata[n] = prevcoeff[n] >= 0 ?
+            bfconf->coeffs_data[prevcoeff[n]] : NULL;
 	if (filters[n].n_filters[IN] == 0) {
 	    mixconvbuf_filters[n] = NULL;
 	    mixconvbuf_filters_map[n] = NULL;
@@ -1383,27 +2524,102 @@ filter_process(struct bfaccess *bfaccess,
     }
 
     /* access all memory while being nobody, so we don't risk getting killed
-       later if memory is scarce */
-    memset(baseptr, 0, memsize);    
-    for (n = 0; n < bfconf->n_coeffs; n++) {
-        for (i = 0; i < bfconf->coeffs[n].n_blocks; i++) {
-            memcpy(ocbuf[0], bfconf->coeffs_data[n][i], convbufsize);
+       later if memory is scarce. All filter processes do this at the same
+       time, and the shared memory is only faulted in, not copied. The
+       coefficients are split between the processes: each takes those its
+       own filters start with, and a share of those no filter starts with */
+    lock = bfconf->realtime_priority && bfconf->lock_memory;
+    lock_ok = true;
+    memset(baseptr, 0, memsize);
+    if (lock && mlock(baseptr, memsize) != 0) {
+        lock_ok = false;
+    }
+    lock_ok = prefault_memory((void *)icomm, icomm_size, lock) && lock_ok;
+    memset(coeff_owner, 0, sizeof(coeff_owner));
+    for (n = 0; n < bfconf->n_filters; n++) {
+        if ((k = icomm->fctrl[n].coeff) >= 0 && k < bfconf->n_coeffs) {
+            coeff_owner[k] = 1;
         }
     }
-    dummydata32 = 0;
-    for (n = 0; n < sizeof(struct intercomm_area) / sizeof(uint32_t); n++) {
-        dummydata32 += ((volatile uint32_t *)icomm)[n];
+    for (n = 0; n < n_filters; n++) {
+        if ((k = icomm->fctrl[filters[n].intname].coeff) >= 0 &&
+            k < bfconf->n_coeffs)
+        {
+            coeff_owner[k] = 2;
+        }
+    }
+    for (n = j = 0; n < bfconf->n_coeffs; n++) {
+        if (coeff_owner[n] == 0) {
+            coeff_owner[n] = n % bfconf->n_processes == process_index ? 2 : 1;
+        }
+        if (coeff_owner[n] == 2) {
+            j += bfconf->coeffs[n].n_blocks;
+        }
+    }
+    /* only show progress if it takes a while */
+    show_progress = process_index == 0 &&
+        (double)j * (double)convbufsize > 64.0 * 1024.0 * 1024.0;
+    progress = 0;
+    if (bfconf->lazy_slots != NULL) {
+        lock_ok = prefault_memory(bfconf->lazy_slots,
+                                  (size_t)bfconf->n_lazy_slots *
+                                  bfconf->lazy_slot_size, lock) && lock_ok;
+    }
+    for (n = i = 0; n < bfconf->n_coeffs; n++) {
+        if (coeff_owner[n] != 2 ||
+            (bfconf->coeff_state != NULL &&
+             bfconf->coeff_state[n] != BF_COEFF_READY))
+        {
+            continue;
+        }
+        if (bfconf->coeffs_spare != NULL && bfconf->coeffs_spare[n] != NULL) {
+            lock_ok = prefault_memory(bfconf->coeffs_spare[n][0],
+                                      (size_t)bfconf->coeffs[n].n_blocks *
+                                      (convbufsize + bfconf->stagger_size),
+                                      lock) && lock_ok;
+        }
+        for (k = 0; k < bfconf->coeffs[n].n_blocks; k++, i++) {
+            lock_ok = prefault_memory(bfconf->coeffs_data[n][k], convbufsize,
+                                      lock) && lock_ok;
+            if (show_progress && 10 * i / j > progress)
+            {
+                if (progress == 0) {
+                    pinfo("%s coefficient memory...",
+                          lock ? "Locking" : "Prefaulting");
+                }
+                progress = 10 * i / j;
+                pinfo("%d%%...", 10 * progress);
+            }
+        }
+    }
+    if (show_progress && progress > 0) {
+        pinfo("finished.\n");
+    }
+    if (!lock_ok) {
+        fprintf(stderr, "Warning: failed to lock all memory of filter "
+                "process %d, the locked memory limit may be too low.\n",
+                process_index);
     }
-    memset(ocbuf[0], 0, convbufsize);
     memset(inbuf[0], 0, dai_buffer_format[IN]->n_bytes);
     memset(inbuf[1], 0, dai_buffer_format[IN]->n_bytes);
     memset(outbuf[0], 0, dai_buffer_format[OUT]->n_bytes);
     memset(outbuf[1], 0, dai_buffer_format[OUT]->n_bytes);
-    for (n = 0; n < n_inputs; n++) {
-        memset(input_freqcbuf[inputs[n]], 0, convbufsize);
+    for (j = 0; j < 2; j++) {
+        for (n = 0; n < n_inputs; n++) {
+            memset(input_freqcbufs[j][inputs[n]], 0, convbufsize);
+        }
+        for (n = 0; n < n_outputs; n++) {
+            memset(output_freqcbufs[j][outputs[n]], 0, convbufsize);
+        }
     }
-    for (n = 0; n < n_outputs; n++) {
-        memset(output_freqcbuf[outputs[n]], 0, convbufsize);
+
+    /* get initial control data, wait if a change is in progress */
+    control_copy_init(&ctrl, n_filters, filters, n_procinputs, procinputs,
+                      n_procoutputs, procoutputs);
+    while (!control_copy_fetch(&ctrl, blockcounter, icomm_fctrl, icomm_delay,
+                               icomm_subdelay, icomm_ismuted))
+    {
+        usleep(1000);
     }
     
     if (bfconf->realtime_priority) {
@@ -1419,6 +2635,18 @@ filter_process(struct bfaccess *bfaccess,
     while (true) {
         gettimeofday(&period_end, NULL);
 
+        /* In pipelined mode the input and output spectra are double buffered.
+           The current block is transformed and convolved into one set, while
+           the previous block is transformed back to time domain from the
+           other, which removes one synchronisation point per block at the
+           cost of one block of extra I/O-delay. */
+        if (bfconf->pipelined) {
+            curspec = (int)(blockcounter & 1);
+            prevspec = !curspec;
+        }
+        input_freqcbuf = input_freqcbufs[curspec];
+        output_freqcbuf = output_freqcbufs[curspec];
+
 	/* wait for next input buffer */
         timestamp(&icomm->debug.f[dbg_pos].r_input.ts_call);
         if (has_bl_input_devs) {
@@ -1444,6 +2672,7 @@ filter_process(struct bfaccess *bfaccess,
         }
         gettimeofday(&period_start, NULL);
 
+        icomm->blockcounter[process_index] = blockcounter;
         if (events.n_block_start > 0) {
             if (process_index == 0) {
                 for (i = 0; i < events.n_block_start; i++) {
@@ -1455,32 +2684,10 @@ filter_process(struct bfaccess *bfaccess,
                                    process_index);
         }
         
-        /* get all shared memory data we need where mutex is important */
+        /* get control data from shared memory, if changed */
         timestamp(&icomm->debug.f[dbg_pos].mutex.ts_call);
-        icomm_mutex(1);
-        for (n = 0; n < n_filters; n++) {
-            icomm_fctrl[n].coeff = icomm->fctrl[filters[n].intname].coeff;
-            icomm_fctrl[n].delayblocks =
-                icomm->fctrl[filters[n].intname].delayblocks;
-            for (i = 0; i < filters[n].n_channels[IN]; i++) {
-                icomm_fctrl[n].scale[IN][i] =
-                    icomm->fctrl[filters[n].intname].scale[IN][i];
-            }
-            for (i = 0; i < filters[n].n_channels[OUT]; i++) {
-                icomm_fctrl[n].scale[OUT][i] =
-                    icomm->fctrl[filters[n].intname].scale[OUT][i];
-            }
-            for (i = 0; i < filters[n].n_filters[IN]; i++) {
-                icomm_fctrl[n].fscale[i] =
-                    icomm->fctrl[filters[n].intname].fscale[i];
-            }
-        }
-        memcpy(icomm_ismuted, icomm->ismuted, sizeof(icomm_ismuted));
-        memcpy(icomm_delay, icomm->delay, sizeof(icomm_delay));
-        if (bfconf->use_subdelay[IN] || bfconf->use_subdelay[OUT]) {
-            memcpy(icomm_subdelay, icomm->subdelay, sizeof(icomm_subdelay));
-        }
-        icomm_mutex(0);
+        control_copy_fetch(&ctrl, blockcounter, icomm_fctrl, icomm_delay,
+                           icomm_subdelay, icomm_ismuted);
 
         /* change to lower priority so we can be pre-empted, but we only do so
            if required by the input (or output) process */
@@ -1496,8 +2703,16 @@ filter_process(struct bfaccess *bfaccess,
 	    virtch = procinputs[n];
 	    physch = bfconf->virt2phys[IN][virtch];
 	    bf = &dai_buffer_format[IN]->bf[physch];
+            delay = icomm_delay[IN][virtch];
+            if (bfconf->use_subdelay[IN] &&
+                bfconf->subdelay[IN][virtch] == BF_UNDEFINED_SUBDELAY)
+            {
+                delay += bfconf->sdf_length;
+            }
             sd_params.subdelay = icomm_subdelay[IN][virtch];
             sd_params.rest = input_sd_rest[virtch];
+            sd_params.vd = input_vd[virtch];
+            sd_params.delay = delay;
 	    if (bfconf->n_virtperphys[IN][physch] == 1) {
                 convolver_raw2cbuf(inbuf[curbuf],
                                    input_timecbuf[n][curbuf],
@@ -1507,16 +2722,10 @@ filter_process(struct bfaccess *bfaccess,
                                    (void *)&sd_params);
 	    } else {
 		if (!bit_isset(icomm_ismuted[IN], virtch)) {
-                    delay = icomm_delay[IN][virtch];
-                    if (bfconf->use_subdelay[IN] &&
-                        bfconf->subdelay[IN][virtch] == BF_UNDEFINED_SUBDELAY)
-                    {
-                        delay += bfconf->sdf_length;
-                    }
 		    delay_update(input_db[virtch],
 				 &((uint8_t *)inbuf[curbuf])[bf->byte_offset],
 				 bf->sf.bytes, bf->sample_spacing,
-				 delay,
+				 input_vd[virtch] != NULL ? 0 : delay,
 				 inbuf_copy);
 		} else {
 		    memset(inbuf_copy, 0, fragsize * bf->sf.bytes);
@@ -1532,6 +2741,12 @@ filter_process(struct bfaccess *bfaccess,
 	    for (i = 0; i < events.n_input_timed; i++) {
 		events.input_timed[i](input_timecbuf[n][curbuf], procinputs[n]);
 	    }
+            if (meter_blocks > 0) {
+                /* the new samples are first in the next buffer */
+                meter_update(input_timecbuf[n][!curbuf], fragsize,
+                             bfconf->realsize, &meter_peak[n],
+                             &meter_sumsq[n]);
+            }
 	    timestamp(&t2);
 	    t[0] += t2 - t1;
 	    
@@ -1545,10 +2760,17 @@ filter_process(struct bfaccess *bfaccess,
             {
                 convolver_time2freq(input_timecbuf[n][curbuf],
                                     input_freqcbuf[procinputs[n]]);
-                input_freqcbuf_zero[procinputs[n]] = false;
-            } else if (!input_freqcbuf_zero[procinputs[n]]) {
+                if (input_sd_ramp[procinputs[n]] != NULL) {
+                    apply_freqd_subdelay(input_freqcbuf[procinputs[n]],
+                                         input_sd_ramp[procinputs[n]],
+                                         &input_sd_ramp_subdelay
+                                         [procinputs[n]],
+                                         icomm_subdelay[IN][procinputs[n]]);
+                }
+                input_freqcbuf_zero[curspec][procinputs[n]] = false;
+            } else if (!input_freqcbuf_zero[curspec][procinputs[n]]) {
                 memset(input_freqcbuf[procinputs[n]], 0, convbufsize);
-                input_freqcbuf_zero[procinputs[n]] = true;
+                input_freqcbuf_zero[curspec][procinputs[n]] = true;
             }
 	    for (i = 0; i < events.n_input_freqd; i++) {
 		events.input_freqd[i](input_freqcbuf[procinputs[n]],
@@ -1575,6 +2797,27 @@ filter_process(struct bfaccess *bfaccess,
                    coefficient */
 		events.coeff_final[0](filters[n].intname, &coeff);
 	    }
+            if (coeff >= 0 && bfconf->coeff_state != NULL &&
+                coeff != prevcoeff[n])
+            {
+                /* pin before checking the state, so the set cannot be
+                   evicted after the check, see coeff_loader_process */
+                __sync_fetch_and_add(&icomm->coeff_pins[coeff], 1);
+                if (bfconf->coeff_state[coeff] != BF_COEFF_READY) {
+                    __sync_fetch_and_sub(&icomm->coeff_pins[coeff], 1);
+                    if (waitcoeff[n] != coeff) {
+                        waitcoeff[n] = coeff;
+                        wake_coeff_loader();
+                    }
+                    /* keep the current coefficients until the new ones
+                       have been loaded */
+                    coeff = prevcoeff[n];
+                }
+            }
+            /* the block pointers are swapped when coefficients are reloaded,
+               which then is treated like a change of coefficients */
+            cdata = coeff >= 0 ? bfconf->coeffs_data[coeff] : NULL;
+            changed = prevcoeff[n] != coeff || prevcdata[n] != cdata;
 	    delay = icomm_fctrl[n].delayblocks;
 	    if (delay < 0) {
 		delay = 0;
@@ -1639,15 +2882,17 @@ filter_process(struct bfaccess *bfaccess,
 		for (i = 0; i < filters[n].n_channels[IN]; i++) {
 		    scales[i] = icomm_fctrl[n].scale[IN][i] *
 			virtscales[IN][filters[n].channels[IN][i]];
-                    if (!input_freqcbuf_zero[filters[n].channels[IN][i]]) {
+                    if (!input_freqcbuf_zero[curspec]
+                        [filters[n].channels[IN][i]])
+                    {
                         iszero = false;
                     }
 		}
 		/* FIXME: unecessary scale multiply for filter-inputs */
 		scales[i] = 1.0;
-		mixconvbuf_inputs[n][i] = static_evalbuf;
+		mixconvbuf_inputs[curspec][n][i] = static_evalbuf;
                 if (!iszero || !powersave) {
-                    convolver_mixnscale(mixconvbuf_inputs[n],
+                    convolver_mixnscale(mixconvbuf_inputs[curspec][n],
                                         cbuf[n][curblock],
                                         scales,
                                         filters[n].n_channels[IN] + 1,
@@ -1662,12 +2907,14 @@ filter_process(struct bfaccess *bfaccess,
 		for (i = 0; i < filters[n].n_channels[IN]; i++) {
 		    scales[i] = icomm_fctrl[n].scale[IN][i] *
 			virtscales[IN][filters[n].channels[IN][i]];
-                    if (!input_freqcbuf_zero[filters[n].channels[IN][i]]) {
+                    if (!input_freqcbuf_zero[curspec]
+                        [filters[n].channels[IN][i]])
+                    {
                         iszero = false;
                     }
 		}
                 if (!iszero || !powersave) {
-                    convolver_mixnscale(mixconvbuf_inputs[n],
+                    convolver_mixnscale(mixconvbuf_inputs[curspec][n],
                                         cbuf[n][curblock],
                                         scales,
                                         filters[n].n_channels[IN],
@@ -1691,27 +2938,23 @@ filter_process(struct bfaccess *bfaccess,
 		if (n_blocks == 1) {
                     /* curblock is always zero when n_blocks == 1 */
                     if (!cbuf_zero[n][0] || !powersave) {
-                        if (filters[n].crossfade && prevcoeff[n] != coeff) {
-                            if (prevcoeff[n] < 0) {
+                        if (filters[n].crossfade && changed) {
+                            if (prevcdata[n] == NULL) {
                                 convolver_dirac_convolve(cbuf[n][0],
                                                          crossfadebuf[0]);
                             } else {
                                 convolver_convolve
                                     (cbuf[n][0],
-                                     bfconf->coeffs_data[prevcoeff[n]][0],
+                                     prevcdata[n][0],
                                      crossfadebuf[0]);
                             }
-                            convolver_convolve_inplace
-                                (cbuf[n][0],
-                                 bfconf->coeffs_data[coeff][0]);
+                            convolver_convolve_inplace(cbuf[n][0], cdata[0]);
                             convolver_crossfade_inplace(cbuf[n][0],
                                                         crossfadebuf[0],
                                                         crossfadebuf[1]);
                             temp_buffer_zero = false;
                         } else {
-                            convolver_convolve_inplace
-                                (cbuf[n][0],
-                                 bfconf->coeffs_data[coeff][0]);
+                            convolver_convolve_inplace(cbuf[n][0], cdata[0]);
                         }
                         /* cbuf points at ocbuf when n_blocks == 1 */
                         ocbuf_zero[n] = false;
@@ -1722,19 +2965,19 @@ filter_process(struct bfaccess *bfaccess,
                     }
 		} else {
                     if (!cbuf_zero[n][curblock] || !powersave) {
-                        if (filters[n].crossfade && prevcoeff[n] != coeff) {
-                            if (prevcoeff[n] < 0) {
+                        if (filters[n].crossfade && changed) {
+                            if (prevcdata[n] == NULL) {
                                 convolver_dirac_convolve(cbuf[n][curblock],
                                                          crossfadebuf[0]);
                             } else {
                                 convolver_convolve
                                     (cbuf[n][curblock],
-                                     bfconf->coeffs_data[prevcoeff[n]][0],
+                                     prevcdata[n][0],
                                      crossfadebuf[0]);
                             }
                         }
                         convolver_convolve(cbuf[n][curblock],
-                                           bfconf->coeffs_data[coeff][0],
+                                           cdata[0],
                                            ocbuf[n]);
                         ocbuf_zero[n] = false;
                     } else if (!ocbuf_zero[n]) {
@@ -1746,13 +2989,13 @@ filter_process(struct bfaccess *bfaccess,
                         if (!cbuf_zero[n][j] || !powersave) {
                             convolver_convolve_add
                                 (cbuf[n][j],
-                                 bfconf->coeffs_data[coeff][i],
+                                 cdata[i],
                                  ocbuf[n]);
                             ocbuf_zero[n] = false;
                         }
 		    }
-                    if (filters[n].crossfade && prevcoeff[n] != coeff &&
-                        prevcoeff[n] >= 0)
+                    if (filters[n].crossfade && changed &&
+                        prevcdata[n] != NULL)
                     {
                         for (i = 1; i < prevcblocks && i < procblocks[n]; i++) {
                             j = (int)((blockcounter - i) %
@@ -1760,7 +3003,7 @@ filter_process(struct bfaccess *bfaccess,
                             if (!cbuf_zero[n][j] || !powersave) {
                                 convolver_convolve_add
                                     (cbuf[n][j],
-                                     bfconf->coeffs_data[prevcoeff[n]][i],
+                                     prevcdata[n][i],
                                      crossfadebuf[0]);
                             }
                             ocbuf_zero[n] = false;
@@ -1769,7 +3012,7 @@ filter_process(struct bfaccess *bfaccess,
                     if (ocbuf_zero[n]) {
                         procblocks[n] = 0;
                         bit_set(partial_proc, n);
-                    } else if (filters[n].crossfade && prevcoeff[n] != coeff) {
+                    } else if (filters[n].crossfade && changed) {
                         convolver_crossfade_inplace(ocbuf[n], crossfadebuf[0],
                                                     crossfadebuf[1]);
                         temp_buffer_zero = false;
@@ -1778,10 +3021,10 @@ filter_process(struct bfaccess *bfaccess,
 	    } else {
 		if (n_blocks == 1) {
                     if (!cbuf_zero[n][0] || !powersave) {
-                        if (filters[n].crossfade && prevcoeff[n] != coeff) {
+                        if (filters[n].crossfade && changed) {
                             convolver_convolve
                                 (cbuf[n][0],
-                                 bfconf->coeffs_data[prevcoeff[n]][0],
+                                 prevcdata[n][0],
                                  crossfadebuf[0]);
                             convolver_dirac_convolve_inplace(cbuf[n][0]);
                             convolver_crossfade_inplace(cbuf[n][0],
@@ -1799,10 +3042,10 @@ filter_process(struct bfaccess *bfaccess,
                     }
 		} else {
                     if (!cbuf_zero[n][curblock] || !powersave) {
-                        if (filters[n].crossfade && prevcoeff[n] != coeff) {
+                        if (filters[n].crossfade && changed) {
                             convolver_convolve
                                 (cbuf[n][curblock],
-                                 bfconf->coeffs_data[prevcoeff[n]][0],
+                                 prevcdata[n][0],
                                  crossfadebuf[0]);
                         }
                         convolver_dirac_convolve(cbuf[n][curblock], ocbuf[n]);
@@ -1811,14 +3054,14 @@ filter_process(struct bfaccess *bfaccess,
                         memset(ocbuf[n], 0, convbufsize);
                         ocbuf_zero[n] = true;
                     }
-                    if (filters[n].crossfade && prevcoeff[n] != coeff) {
+                    if (filters[n].crossfade && changed) {
                         for (i = 1; i < prevcblocks && i < procblocks[n]; i++) {
                             j = (int)((blockcounter - i) %
                                       (unsigned int)n_blocks);
                             if (!cbuf_zero[n][j] || !powersave) {
                                 convolver_convolve_add
                                     (cbuf[n][j],
-                                     bfconf->coeffs_data[prevcoeff[n]][i],
+                                     prevcdata[n][i],
                                      crossfadebuf[0]);
                             }
                             ocbuf_zero[n] = false;
@@ -1827,14 +3070,22 @@ filter_process(struct bfaccess *bfaccess,
                     if (ocbuf_zero[n]) {
                         procblocks[n] = 0;
                         bit_set(partial_proc, n);
-                    } else if (filters[n].crossfade && prevcoeff[n] != coeff) {
+                    } else if (filters[n].crossfade && changed) {
                         convolver_crossfade_inplace(ocbuf[n], crossfadebuf[0],
                                                     crossfadebuf[1]);
                         temp_buffer_zero = false;
                     }
 		}
 	    }
+            if (prevcoeff[n] != coeff) {
+                icomm->used_coeff[filters[n].intname] = coeff;
+                if (prevcoeff[n] >= 0 && bfconf->coeff_state != NULL) {
+                    __sync_fetch_and_sub(&icomm->coeff_pins[prevcoeff[n]], 1);
+                }
+                waitcoeff[n] = -1;
+            }
             prevcoeff[n] = coeff;
+            prevcdata[n] = cdata;
 	    for (i = 0; i < events.n_post_convolve; i++) {
 		events.post_convolve[i](cbuf[n][curblock], n);
 	    }
@@ -1859,17 +3110,20 @@ filter_process(struct bfaccess *bfaccess,
                                     scales,
                                     outconvbuf_n_filters[n],
                                     CONVOLVER_MIXMODE_OUTPUT);
-                output_freqcbuf_zero[outputs[n]] = false;
-            } else if (!output_freqcbuf_zero[outputs[n]]) {
+                output_freqcbuf_zero[curspec][outputs[n]] = false;
+            } else if (!output_freqcbuf_zero[curspec][outputs[n]]) {
                 memset(output_freqcbuf[outputs[n]], 0, convbufsize);
-                output_freqcbuf_zero[outputs[n]] = true;
+                output_freqcbuf_zero[curspec][outputs[n]] = true;
             }
 	}
 	timestamp(&t2);
 	t[4] += t2 - t1;
 	
         timestamp(&icomm->debug.f[dbg_pos].fsynch_td.ts_call);
-        synch_filter_processes(filter_readfd, filter_writefd, process_index);
+        if (!bfconf->pipelined) {
+            synch_filter_processes(filter_readfd, filter_writefd,
+                                   process_index);
+        }
         timestamp(&icomm->debug.f[dbg_pos].fsynch_td.ts_ret);
 
 	mixbuf_is_filled = false;
@@ -1879,11 +3133,19 @@ filter_process(struct bfaccess *bfaccess,
 	    virtch = procoutputs[n];
 	    physch = bfconf->virt2phys[OUT][virtch];
 	    for (i = 0; i < events.n_output_freqd; i++) {
-		events.output_freqd[i](output_freqcbuf[virtch], virtch);
+		events.output_freqd[i](output_freqcbufs[prevspec][virtch],
+                                       virtch);
 	    }
 	    /* ocbuf[0] happens to be free, that's why we use it */
-            if (!output_freqcbuf_zero[virtch] || !powersave) {
-                convolver_freq2time(output_freqcbuf[virtch], ocbuf[0]);
+            if (!output_freqcbuf_zero[prevspec][virtch] || !powersave) {
+                if (output_sd_ramp[virtch] != NULL) {
+                    apply_freqd_subdelay(output_freqcbufs[prevspec][virtch],
+                                         output_sd_ramp[virtch],
+                                         &output_sd_ramp_subdelay[virtch],
+                                         icomm_subdelay[OUT][virtch]);
+                }
+                convolver_freq2time(output_freqcbufs[prevspec][virtch],
+                                    ocbuf[0]);
                 ocbuf_zero[0] = false;
                 if (n_blocks == 1) {
                     cbuf_zero[0][0] = false;
@@ -1917,11 +3179,31 @@ filter_process(struct bfaccess *bfaccess,
 	    for (i = 0; i < events.n_output_timed; i++) {
 		events.output_timed[i](ocbuf[0], virtch);
 	    }
+            if (meter_blocks > 0) {
+                meter_update(ocbuf[0], fragsize, bfconf->realsize,
+                             &meter_peak[n_procinputs + n],
+                             &meter_sumsq[n_procinputs + n]);
+            }
             if (output_sd_rest[virtch] != NULL) {
                 delay_subsample_update(ocbuf[0],
                                        output_sd_rest[virtch],
                                        icomm_subdelay[OUT][virtch]);
             }
+            delay = icomm_delay[OUT][virtch];
+            if (bfconf->use_subdelay[OUT] &&
+                bfconf->subdelay[OUT][virtch] == BF_UNDEFINED_SUBDELAY)
+            {
+                delay += bfconf->sdf_length;
+            }
+            if (output_vd[virtch] != NULL) {
+                delay_vardelay_update(output_vd[virtch], ocbuf[0], delay);
+                /* the delayed tail is written in place, so the buffer is
+                   not known to be zero any longer */
+                ocbuf_zero[0] = false;
+                if (n_blocks == 1) {
+                    cbuf_zero[0][0] = false;
+                }
+            }
 	    if (bfconf->n_virtperphys[OUT][physch] == 1) {
 		/* only one virtual channel allocated to this physical one, so
 		   we write to it directly */                
@@ -1938,14 +3220,10 @@ filter_process(struct bfaccess *bfaccess,
 		   where we get lower I/O-delay on mute and delay operations.
 		   However, when mixing to a single physical channel we cannot
 		   do it there, so we must do it here instead. */
-                delay = icomm_delay[OUT][virtch];
-                if (bfconf->use_subdelay[OUT] &&
-                    bfconf->subdelay[OUT][virtch] == BF_UNDEFINED_SUBDELAY)
-                {
-                    delay += bfconf->sdf_length;
+                if (output_db[virtch] != NULL) {
+                    delay_update(output_db[virtch], ocbuf[0],
+                                 bfconf->realsize, 1, delay, NULL);
                 }
-		delay_update(output_db[virtch], ocbuf[0], bfconf->realsize, 1,
-			     delay, NULL);
 		if (!bit_isset(icomm_ismuted[OUT], virtch)) {
 		    if (!mixbuf_is_filled) {
 			memcpy(mixbuf, ocbuf[0], fragsize * bfconf->realsize);
@@ -2026,6 +3304,13 @@ filter_process(struct bfaccess *bfaccess,
         }
         timestamp(&icomm->debug.f[dbg_pos].w_output.ts_ret);
 	
+        if (meter_blocks > 0 && ++meter_count == meter_blocks) {
+            meter_publish(process_index, n_procinputs, procinputs,
+                          n_procoutputs, procoutputs, meter_peak, meter_sumsq,
+                          meter_scale, meter_blocks * fragsize);
+            meter_count = 0;
+        }
+        
 	/* swap convolve buffers */
 	curbuf = !curbuf;
 
@@ -2076,7 +3361,7 @@ freq2time |  real2raw |     total | periods | rti \n\
 	    }
 	}
 
-        if (++dbg_pos == DEBUG_RING_BUFFER_SIZE) {
+        if (++dbg_pos == debug_ring_size) {
             dbg_pos = 0;
         }
     }
@@ -2128,6 +3413,67 @@ bf_callback_ready(int io)
     }
 }
 
+#define ICOMM_CARVE(member, count)                                             \
+    if (base != NULL) {                                                        \
+        ic->member = (void *)&base[size];                                      \
+    }                                                                          \
+    size += ((count) * sizeof(*ic->member) + ALIGNMENT - 1) &                  \
+        ~(ALIGNMENT - 1);
+
+/* Lay out the intercomm area arrays after the struct. If 'base' is NULL,
+   only the total size is calculated. */
+static size_t
+icomm_layout(uint8_t *base)
+{
+    volatile struct intercomm_area *ic;
+    size_t size;
+    int n, i, n_scales;
+
+    ic = (volatile struct intercomm_area *)base;
+    size = (sizeof(struct intercomm_area) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    schedule_stride = 1;
+    for (n = n_scales = 0; n < bfconf->n_filters; n++) {
+        i = bfconf->filters[n].n_channels[IN] +
+            bfconf->filters[n].n_channels[OUT] +
+            bfconf->filters[n].n_filters[IN];
+        n_scales += i;
+        if (i > schedule_stride) {
+            schedule_stride = i;
+        }
+    }
+    ICOMM_CARVE(period_us, bfconf->n_processes);
+    ICOMM_CARVE(full_proc, bfconf->n_processes);
+    ICOMM_CARVE(meter_frame, bfconf->n_processes);
+    ICOMM_CARVE(blockcounter, bfconf->n_processes);
+    ICOMM_CARVE(shm_usage, bfconf->n_processes);
+    /* main, coefficient loader, input, output and callback processes, plus
+       filter processes and forked logic modules */
+    ICOMM_CARVE(pids, bfconf->n_processes + bfconf->n_logicmods + 8);
+    ICOMM_CARVE(fctrl, bfconf->n_filters);
+    fctrl_n_scales = n_scales;
+    ICOMM_CARVE(fctrl_scales, n_scales);
+    ICOMM_CARVE(used_coeff, bfconf->n_filters);
+    ICOMM_CARVE(coeff_pins, bfconf->n_coeffs);
+    ICOMM_CARVE(overflow, bfconf->n_channels[OUT]);
+    FOR_IN_AND_OUT {
+        ICOMM_CARVE(ismuted[IO], bfconf->n_channels[IO] / 32 + 1);
+        ICOMM_CARVE(delay[IO], bfconf->n_channels[IO]);
+        ICOMM_CARVE(subdelay[IO], bfconf->n_channels[IO]);
+    }
+    ICOMM_CARVE(debug.i, debug_ring_size);
+    ICOMM_CARVE(debug.o, debug_ring_size);
+    ICOMM_CARVE(debug.f, debug_ring_size);
+    ICOMM_CARVE(schedule, SCHEDULE_QUEUE_SIZE);
+    ICOMM_CARVE(schedule_scales, SCHEDULE_QUEUE_SIZE * schedule_stride);
+    ICOMM_CARVE(fctrl_block, bfconf->n_filters);
+    ICOMM_CARVE(meter_ring, bfconf->meter_rate > 0 ?
+                METER_RING_SIZE * (bfconf->n_channels[IN] +
+                                   bfconf->n_channels[OUT]) : 0);
+    return size;
+}
+
+#undef ICOMM_CARVE
+
 void
 bfrun(void)
 {
@@ -2137,11 +3483,14 @@ bfrun(void)
     int filter_writefd[bfconf->n_processes];
     char dummydata[bfconf->n_processes];
     void *buffers[2][2];
-    void *input_freqcbuf[bfconf->n_channels[IN]], *input_freqcbuf_base;
-    void *output_freqcbuf[bfconf->n_channels[OUT]], *output_freqcbuf_base;
+    void *input_freqcbuf[2][bfconf->n_channels[IN]], *input_freqcbuf_base;
+    void *output_freqcbuf[2][bfconf->n_channels[OUT]], *output_freqcbuf_base;
+    void **input_freqcbufs[2], **output_freqcbufs[2];
     int nc[2], cpos[2], channels[2][BF_MAXCHANNELS];
-    int n, i, j, cbufsize, physch;
+    int n, i, j, cbufsize, spectsize, physch, n_spectra;
+    volatile double *scales;
     bool_t checkdrift, trigger;
+    size_t shm_total, shm_hugetlb, shm_thp;
     struct bfaccess bfaccess;
     pid_t pid;
 
@@ -2163,38 +3512,77 @@ bfrun(void)
     
     /* allocate shared memory for I/O buffers and interprocess communication */
     cbufsize = convolver_cbufsize();
-    if ((input_freqcbuf_base = shmalloc(bfconf->n_channels[IN] * cbufsize))
-	== NULL ||
-	(output_freqcbuf_base = shmalloc(bfconf->n_channels[OUT] * cbufsize))
-	== NULL ||
-	(icomm = shmalloc(sizeof(struct intercomm_area))) == NULL)
+    n_spectra = bfconf->pipelined ? 2 : 1;
+    debug_ring_size = bfconf->debug ?
+        DEBUG_RING_BUFFER_SIZE : NODEBUG_RING_BUFFER_SIZE;
+    icomm_size = icomm_layout(NULL);
+    spectsize = cbufsize + bfconf->stagger_size;
+    if ((input_freqcbuf_base =
+         shmalloc(n_spectra * bfconf->n_channels[IN] * spectsize)) == NULL ||
+	(output_freqcbuf_base =
+         shmalloc(n_spectra * bfconf->n_channels[OUT] * spectsize)) == NULL ||
+	(icomm = shmalloc(icomm_size)) == NULL)
     {
 	fprintf(stderr, "Failed to allocate shared memory: %s.\n",
 		strerror(errno));
         bf_exit(BF_EXIT_NO_MEMORY);
         return;
     }
-    for (n = 0; n < bfconf->n_channels[IN]; n++) {
-	input_freqcbuf[n] = input_freqcbuf_base;
-        input_freqcbuf_base = (uint8_t *)input_freqcbuf_base + cbufsize;
-    }
-    for (n = 0; n < bfconf->n_channels[OUT]; n++) {
-	output_freqcbuf[n] = output_freqcbuf_base;
-	output_freqcbuf_base = (uint8_t *)output_freqcbuf_base + cbufsize;
+    emalloc_account(EMALLOC_CAT_IOBUFS, n_spectra * spectsize *
+                    (bfconf->n_channels[IN] + bfconf->n_channels[OUT]));
+    for (i = 0; i < n_spectra; i++) {
+        for (n = 0; n < bfconf->n_channels[IN]; n++) {
+            input_freqcbuf[i][n] = input_freqcbuf_base;
+            input_freqcbuf_base = (uint8_t *)input_freqcbuf_base + spectsize;
+        }
+        for (n = 0; n < bfconf->n_channels[OUT]; n++) {
+            output_freqcbuf[i][n] = output_freqcbuf_base;
+            output_freqcbuf_base = (uint8_t *)output_freqcbuf_base + spectsize;
+        }
     }
+    /* without pipelining both spectrum sets are the same */
+    input_freqcbufs[0] = input_freqcbuf[0];
+    input_freqcbufs[1] = input_freqcbuf[n_spectra - 1];
+    output_freqcbufs[0] = output_freqcbuf[0];
+    output_freqcbufs[1] = output_freqcbuf[n_spectra - 1];
     
     /* initialise process intercomm area */
-    for (n = 0; n < sizeof(struct intercomm_area); n++) {
+    for (n = 0; n < icomm_size; n++) {
         ((volatile uint8_t *)icomm)[n] = 0;
     }
-    for (n = 0; n < sizeof(icomm->debug); n++) {
-        ((volatile uint8_t *)&icomm->debug)[n] = ~0;
+    icomm_layout((uint8_t *)icomm);
+    for (n = 0; n < debug_ring_size; n++) {
+        memset((void *)&icomm->debug.i[n], ~0,
+               sizeof(struct debug_input_process));
+        memset((void *)&icomm->debug.o[n], ~0,
+               sizeof(struct debug_output_process));
+        memset((void *)&icomm->debug.f[n], ~0,
+               sizeof(struct debug_filter_process));
     }
+    scales = icomm->fctrl_scales;
     for (n = 0; n < bfconf->n_filters; n++) {
-        icomm->fctrl[n] = bfconf->initfctrl[n];
+        icomm->fctrl[n].coeff = bfconf->initfctrl[n].coeff;
+        icomm->used_coeff[n] = bfconf->initfctrl[n].coeff;
+        if (bfconf->initfctrl[n].coeff >= 0) {
+            icomm->coeff_pins[bfconf->initfctrl[n].coeff] += 1;
+        }
+        icomm->fctrl[n].delayblocks = bfconf->initfctrl[n].delayblocks;
+        FOR_IN_AND_OUT {
+            icomm->fctrl[n].scale[IO] = (double *)scales;
+            for (i = 0; i < bfconf->filters[n].n_channels[IO]; i++) {
+                *scales++ = bfconf->initfctrl[n].scale[IO][i];
+            }
+        }
+        icomm->fctrl[n].fscale = (double *)scales;
+        for (i = 0; i < bfconf->filters[n].n_filters[IN]; i++) {
+            *scales++ = bfconf->initfctrl[n].fscale[i];
+        }
     }
+    lock_fctrl_ints = emalloc((2 * bfconf->n_filters + 1) * sizeof(int));
+    lock_fctrl_scales = emalloc((fctrl_n_scales + 1) * sizeof(double));
     icomm->pids[0] = getpid();
     icomm->n_pids = 1;
+    icomm->reload.coeff = -1;
     icomm->exit_status = BF_EXIT_OK;
     FOR_IN_AND_OUT {
         for (n = 0; n < bfconf->n_channels[IO]; n++) {
@@ -2216,6 +3604,31 @@ bfrun(void)
         bf_exit(BF_EXIT_OTHER);
         return;
     }
+
+    /* start the loader of lazily loaded and reloaded coefficients */
+    if (bfconf->coeff_state != NULL || bfconf->coeffs_spare != NULL) {
+        if (pipe(loader_pipe) == -1 ||
+            fcntl(loader_pipe[1], F_SETFL, O_NONBLOCK) == -1)
+        {
+            fprintf(stderr, "Failed to create pipe: %s.\n", strerror(errno));
+            bf_exit(BF_EXIT_OTHER);
+            return;
+        }
+        switch (pid = fork()) {
+        case 0:
+            coeff_loader_process();
+            /* never reached */
+            return;
+        case -1:
+            fprintf(stderr, "Fork failed: %s.\n", strerror(errno));
+            bf_exit(BF_EXIT_OTHER);
+            return;
+        default:
+            icomm->pids[icomm->n_pids] = pid;
+            icomm->n_pids += 1;
+            break;
+        }
+    }
     
     /* create synchronisation pipes */
     for (n = 0; n < bfconf->n_processes; n++) {
@@ -2259,6 +3672,12 @@ bfrun(void)
         bf_exit(BF_EXIT_OTHER);
         return;
     }
+    pinfo("Memory usage: coefficients %.1f MB, delay lines %.1f MB, "
+          "dither %.1f MB, I/O buffers %.1f MB.\n",
+          (double)emalloc_usage(EMALLOC_CAT_COEFFS) / (1024.0 * 1024.0),
+          (double)emalloc_usage(EMALLOC_CAT_DELAY) / (1024.0 * 1024.0),
+          (double)emalloc_usage(EMALLOC_CAT_DITHER) / (1024.0 * 1024.0),
+          (double)emalloc_usage(EMALLOC_CAT_IOBUFS) / (1024.0 * 1024.0));
 
     /* init overflow structure */
     reset_overflow = emalloc(sizeof(struct bfoverflow) *
@@ -2277,6 +3696,14 @@ bfrun(void)
         icomm->overflow[n] = reset_overflow[n];
     }
 
+    if (bfconf->hugepages) {
+        /* reported when the filter processes have allocated theirs too */
+        shmalloc_usage(&shm_total, &shm_hugetlb, &shm_thp);
+        icomm->shm_usage_main.total = shm_total;
+        icomm->shm_usage_main.hugetlb = shm_hugetlb;
+        icomm->shm_usage_main.thp = shm_thp;
+    }
+
     /* initialise event listener structure */
     init_events();
     
@@ -2305,6 +3732,10 @@ bfrun(void)
     bfaccess.convolver_fftplan = convolver_fftplan;
     bfaccess.set_subdelay = set_subdelay;
     bfaccess.get_subdelay = get_subdelay;
+    bfaccess.reload_coeff = reload_coeff;
+    bfaccess.read_levels = read_levels;
+    bfaccess.schedule_filter = schedule_filter;
+    bfaccess.current_block = current_block;
 
     /* create filter processes */
     cpos[IN] = cpos[OUT] = 0;
@@ -2347,8 +3778,8 @@ bfrun(void)
 	    filter_process(&bfaccess,
                            buffers[IN],
 			   buffers[OUT],
-			   input_freqcbuf,
-			   output_freqcbuf,
+			   input_freqcbufs,
+			   output_freqcbufs,
 			   filter2filter_pipes[n][0],
 			   filter_writefd,
 			   bl_input_2_filter[0],
@@ -2491,6 +3922,7 @@ bfrun(void)
             bf_exit(BF_EXIT_NO_MEMORY);
             return;
         }
+        print_shm_usage();
         pinfo("Audio processing starts now\n");
         dai_trigger_callback_io();
         for (n = 0; n < icomm->n_pids; n++) {
@@ -0,0 +1,276 @@
+/*
+ * (c) Copyright 2026 -- Anders Torger
+ *
+ * This program is open source. For license terms, see the LICENSE file.
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "sysarch.h"
+#include "bfshm.h"
+
+struct bfshm {
+    struct bfshm_header *header;
+    size_t size;
+};
+
+struct bfshm *
+bfshm_open(const char path[])
+{
+    struct bfshm_header *header;
+    struct bfshm *shm;
+    struct stat st;
+    void *p;
+    int fd;
+
+    if ((fd = open(path, O_RDWR)) == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*header)) {
+        close(fd);
+        return NULL;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    header = (struct bfshm_header *)p;
+    if (header->magic != BFSHM_MAGIC || header->version != BFSHM_VERSION ||
+        header->size != (uint32_t)st.st_size || !header->ready)
+    {
+        munmap(p, st.st_size);
+        return NULL;
+    }
+    if ((shm = malloc(sizeof(struct bfshm))) == NULL) {
+        munmap(p, st.st_size);
+        return NULL;
+    }
+    shm->header = header;
+    shm->size = st.st_size;
+    return shm;
+}
+
+void
+bfshm_close(struct bfshm *shm)
+{
+    munmap(shm->header, shm->size);
+    free(shm);
+}
+
+const struct bfshm_header *
+bfshm_header(struct bfshm *shm)
+{
+    return shm->header;
+}
+
+int
+bfshm_filter_index(struct bfshm *shm,
+                   const char name[])
+{
+    int n;
+
+    for (n = 0; n < shm->header->n_filters; n++) {
+        if (strcmp(BFSHM_FILTER(shm->header, n)->name, name) == 0) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+int
+bfshm_channel_index(struct bfshm *shm,
+                    int io,
+                    const char name[])
+{
+    int n;
+
+    if (io != 0 && io != 1) {
+        return -1;
+    }
+    for (n = 0; n < shm->header->n_channels[io]; n++) {
+        if (strcmp(BFSHM_CHANNEL(shm->header, io, n)->name, name) == 0) {
+            return n;
+        }
+    }
+    return -1;
+}
+
+int
+bfshm_control_begin(struct bfshm *shm)
+{
+    switch (pthread_mutex_lock(&shm->header->lock)) {
+    case 0:
+        break;
+    case EOWNERDEAD:
+        /* the previous owner died, possibly in the middle of a change */
+        if (pthread_mutex_consistent(&shm->header->lock) != 0) {
+            pthread_mutex_unlock(&shm->header->lock);
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    /* already odd if the previous owner died before committing */
+    if ((shm->header->control_seq & 1) == 0) {
+        shm->header->control_seq++;
+    }
+    MEMORY_BARRIER();
+    return 0;
+}
+
+void
+bfshm_control_commit(struct bfshm *shm)
+{
+    MEMORY_BARRIER();
+    shm->header->control_seq++;
+    pthread_mutex_unlock(&shm->header->lock);
+}
+
+int
+bfshm_set_coeff(struct bfshm *shm,
+                int filter,
+                int coeff)
+{
+    if (filter < 0 || filter >= shm->header->n_filters) {
+        return -1;
+    }
+    BFSHM_FILTER(shm->header, filter)->coeff = coeff;
+    return 0;
+}
+
+int
+bfshm_set_delayblocks(struct bfshm *shm,
+                      int filter,
+                      int delayblocks)
+{
+    if (filter < 0 || filter >= shm->header->n_filters) {
+        return -1;
+    }
+    BFSHM_FILTER(shm->header, filter)->delayblocks = delayblocks;
+    return 0;
+}
+
+int
+bfshm_set_scale(struct bfshm *shm,
+                int filter,
+                int io,
+                int index,
+                double scale)
+{
+    struct bfshm_filter *f;
+
+    if (filter < 0 || filter >= shm->header->n_filters) {
+        return -1;
+    }
+    f = BFSHM_FILTER(shm->header, filter);
+    switch (io) {
+    case 0:
+        if (index < 0 || index >= f->n_channels[0]) {
+            return -1;
+        }
+        break;
+    case 1:
+        if (index < 0 || index >= f->n_channels[1]) {
+            return -1;
+        }
+        index += f->n_channels[0];
+        break;
+    case 2:
+        if (index < 0 || index >= f->n_filters) {
+            return -1;
+        }
+        index += f->n_channels[0] + f->n_channels[1];
+        break;
+    default:
+        return -1;
+    }
+    f->scale[index] = scale;
+    return 0;
+}
+
+int
+bfshm_set_delay(struct bfshm *shm,
+                int io,
+                int channel,
+                int delay)
+{
+    if ((io != 0 && io != 1) || channel < 0 ||
+        channel >= shm->header->n_channels[io])
+    {
+        return -1;
+    }
+    BFSHM_CHANNEL(shm->header, io, channel)->delay = delay;
+    return 0;
+}
+
+int
+bfshm_set_mute(struct bfshm *shm,
+               int io,
+               int channel,
+               int muted)
+{
+    if ((io != 0 && io != 1) || channel < 0 ||
+        channel >= shm->header->n_channels[io])
+    {
+        return -1;
+    }
+    BFSHM_CHANNEL(shm->header, io, channel)->muted = !!muted;
+    return 0;
+}
+
+int
+bfshm_read_meters(struct bfshm *shm,
+                  struct bfshm_meter meters[],
+                  int n_meters)
+{
+    uint32_t seq;
+
+    if (n_meters > shm->header->n_channels[1]) {
+        n_meters = shm->header->n_channels[1];
+    }
+    do {
+        while ((seq = shm->header->meter_seq) & 1) {
+            sched_yield();
+        }
+        MEMORY_BARRIER();
+        memcpy(meters, BFSHM_METER(shm->header, 0),
+               n_meters * sizeof(struct bfshm_meter));
+        MEMORY_BARRIER();
+    } while (seq != shm->header->meter_seq);
+    return n_meters;
+}
+
+int
+bfshm_read_levels(struct bfshm *shm,
+                  struct bfshm_level levels[],
+                  int n_levels,
+                  uint32_t *frame)
+{
+    uint32_t seq;
+
+    if (n_levels > shm->header->n_channels[0] + shm->header->n_channels[1]) {
+        n_levels = shm->header->n_channels[0] + shm->header->n_channels[1];
+    }
+    do {
+        while ((seq = shm->header->meter_seq) & 1) {
+            sched_yield();
+        }
+        MEMORY_BARRIER();
+        memcpy(levels, BFSHM_LEVEL(shm->header, 0, 0),
+               n_levels * sizeof(struct bfshm_level));
+        *frame = shm->header->level_frame;
+        MEMORY_BARRIER();
+    } while (seq != shm->header->meter_seq);
+    return n_levels;
+}
@@ -0,0 +1,192 @@
+/*
+ * (c) Copyright 2026 -- Anders Torger
+ *
+ * This program is open source. For license terms, see the LICENSE file.
+ *
+ */
+#ifndef _BFSHM_H_
+#define _BFSHM_H_
+
+#include <inttypes.h>
+#include <pthread.h>
+
+/*
+ * Layout of the shared memory file published by the "shm" logic module, and
+ * a small client library for it. Everything is in the byte order of the host.
+ *
+ * The file starts with the header, followed by the filters, the channels
+ * (inputs, then outputs), the meters of the output channels and last the
+ * levels of all channels (inputs, then outputs). The
+ * filters and channels make up the control area, which holds the state the
+ * clients want. When it has been changed, the logic module applies what the
+ * clients have changed since the last time to the running filters at the
+ * next block start, all at once. Changes made in other ways (for example
+ * through the CLI) are not reflected in the control area, and are kept until
+ * a client changes the same setting.
+ *
+ * The control area is protected by a robust process shared mutex between the
+ * clients, and a sequence counter which is odd while a client is writing. If
+ * a client dies while holding the mutex, the next client takes over its
+ * unfinished changes and commits them together with its own. The meters and
+ * levels have a sequence counter of their own, written by BruteFIR each block.
+ * The levels are only measured if meter_rate is set in the configuration, and
+ * level_frame is incremented each time a new set is available.
+ */
+
+#define BFSHM_MAGIC 0x4246534D
+#define BFSHM_VERSION 3
+#define BFSHM_MAXNAME 128
+
+struct bfshm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    int32_t sample_rate;
+    int32_t block_length;
+    int32_t n_filters;
+    int32_t n_channels[2];
+    uint32_t filter_stride;
+    uint32_t filters_offset;
+    uint32_t channels_offset;
+    uint32_t meters_offset;
+    uint32_t levels_offset;
+    /* set when BruteFIR has filled in the initial state */
+    volatile uint32_t ready;
+    volatile uint32_t control_seq;
+    volatile uint32_t meter_seq;
+    volatile uint32_t block_index;
+    volatile uint32_t level_frame;
+    uint32_t reserved;
+    pthread_mutex_t lock;
+};
+
+/* followed by the scales of the inputs, the outputs and the input filters */
+struct bfshm_filter {
+    char name[BFSHM_MAXNAME];
+    int32_t n_channels[2];
+    int32_t n_filters;
+    int32_t coeff;
+    int32_t delayblocks;
+    int32_t reserved;
+    double scale[];
+};
+
+struct bfshm_channel {
+    char name[BFSHM_MAXNAME];
+    int32_t delay;
+    int32_t muted;
+};
+
+struct bfshm_meter {
+    /* largest absolute sample value since the last peak reset, relative to
+       full scale */
+    double peak;
+    uint32_t n_overflows;
+    uint32_t reserved;
+};
+
+/* block peak and RMS over 1 / meter_rate seconds, relative to full scale */
+struct bfshm_level {
+    float peak;
+    float rms;
+};
+
+#define BFSHM_FILTER(header, index)                                            \
+    ((struct bfshm_filter *)((uint8_t *)(header) + (header)->filters_offset + \
+                             (index) * (header)->filter_stride))
+#define BFSHM_CHANNEL(header, io, index)                                       \
+    (&((struct bfshm_channel *)((uint8_t *)(header) +                          \
+                                (header)->channels_offset))                    \
+     [(io) == 0 ? (index) : (header)->n_channels[0] + (index)])
+#define BFSHM_METER(header, index)                                             \
+    (&((struct bfshm_meter *)((uint8_t *)(header) +                            \
+                              (header)->meters_offset))[index])
+#define BFSHM_LEVEL(header, io, index)                                         \
+    (&((struct bfshm_level *)((uint8_t *)(header) +                            \
+                              (header)->levels_offset))                        \
+     [(io) == 0 ? (index) : (header)->n_channels[0] + (index)])
+
+/* client library */
+
+struct bfshm;
+
+/* Map the given file. Returns NULL if it cannot be opened, is of an
+   incompatible version, or BruteFIR has not yet started. */
+struct bfshm *
+bfshm_open(const char path[]);
+
+void
+bfshm_close(struct bfshm *shm);
+
+const struct bfshm_header *
+bfshm_header(struct bfshm *shm);
+
+/* Returns the index of the filter or channel (io 0 for inputs, 1 for
+   outputs) with the given name, or -1 if it does not exist. */
+int
+bfshm_filter_index(struct bfshm *shm,
+                   const char name[]);
+
+int
+bfshm_channel_index(struct bfshm *shm,
+                    int io,
+                    const char name[]);
+
+/* All changes between begin and commit are applied together, at the same
+   block. Begin returns -1 if the lock could not be taken, and commit must
+   then not be called. The setters return -1 if an index is out of range,
+   else 0. Scales are multipliers, as in the configuration. 'io' 0 is inputs,
+   1 outputs and 2 input filters. */
+int
+bfshm_control_begin(struct bfshm *shm);
+
+void
+bfshm_control_commit(struct bfshm *shm);
+
+int
+bfshm_set_coeff(struct bfshm *shm,
+                int filter,
+                int coeff);
+
+int
+bfshm_set_delayblocks(struct bfshm *shm,
+                      int filter,
+                      int delayblocks);
+
+int
+bfshm_set_scale(struct bfshm *shm,
+                int filter,
+                int io,
+                int index,
+                double scale);
+
+int
+bfshm_set_delay(struct bfshm *shm,
+                int io,
+                int channel,
+                int delay);
+
+int
+bfshm_set_mute(struct bfshm *shm,
+               int io,
+               int channel,
+               int muted);
+
+/* Copy a consistent snapshot of the output meters. Returns the number of
+   meters copied, at most 'n_meters'. */
+int
+bfshm_read_meters(struct bfshm *shm,
+                  struct bfshm_meter meters[],
+                  int n_meters);
+
+/* Copy a consistent snapshot of the levels, inputs first and then outputs.
+   '*frame' is set to the level frame of the snapshot, which is zero if no
+   levels have been measured. Returns the number of levels copied, at most
+   'n_levels'. */
+int
+bfshm_read_levels(struct bfshm *shm,
+                  struct bfshm_level levels[],
+                  int n_levels,
+                  uint32_t *frame);
+
+#endif
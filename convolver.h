@@ -13,6 +13,11 @@
 #include "bfmod.h"
 #include "dai.h"
 
+/* Version of the convolver's internal frequency-domain format. Must be
+   increased if the format changes, since preprocessed coefficients are cached
+   on disk. */
+#define CONVOLVER_CBUF_FORMAT_VERSION 1
+
 /* Convert from raw sample format to the convolver's own time-domain format. */
 void
 convolver_raw2cbuf(void *rawbuf,
@@ -112,6 +117,15 @@ void
 convolver_runtime_coeffs2cbuf(void *src,
                               void *dest);
 
+/* Fill 'dest' with the frequency-domain representation of a delay of 'delay'
+   samples (-1 < delay < 1), a linear phase ramp. Convolving with it delays
+   the contents of a cbuf circularly within its FFT block. This is an
+   unwindowed sinc interpolation, so for a fractional delay the contents
+   spread into the zero padded half of a filter cbuf, which aliases in the
+   overlap-save convolution. */
+void
+convolver_subdelay2cbuf(double delay,
+                        void *dest);
 
 /* Make a quick sanity check */
 bool_t
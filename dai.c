@@ -37,6 +37,14 @@
 #include "timermacros.h"
 #include "numunion.h"
 
+#ifdef __OS_LINUX__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#define DAI_USE_EPOLL
+#else
+#include <poll.h>
+#endif
+
 /* FIXME: use bfconf directly in more situations? */
 
 #define CB_MSG_START 1
@@ -48,6 +56,15 @@ struct subdev {
     bool_t uses_clock;
     bool_t isinterleaved;
     bool_t bad_alignment;
+    bool_t pending; /* data left to transfer this period */
+    bool_t armed;   /* waited for */
+    bool_t ready;   /* reported ready by the last wait */
+#ifdef DAI_USE_EPOLL
+    bool_t registered;
+    bool_t always_ready; /* cannot be waited for, like regular files */
+#else
+    int pfd_index;
+#endif
     int index;
     int fd;
     int buf_size;
@@ -65,17 +82,19 @@ struct subdev {
     } cb;
 };
 
+/* The arrays are sized after the configuration, and are placed in the same
+   shared memory segment, directly after the struct itself. */
 struct comarea {
     volatile bool_t blocking_stopped;
     volatile int lastbuf_index;
     volatile int frames_left;
     volatile int cb_lastbuf_index;
     volatile int cb_frames_left;
-    volatile bool_t is_muted[2][BF_MAXCHANNELS];
-    volatile int delay[2][BF_MAXCHANNELS];
+    volatile bool_t *is_muted[2];
+    volatile int *delay[2];
     volatile pid_t pid[2];
     volatile pid_t callback_pid;
-    struct subdev dev[2][BF_MAXCHANNELS];
+    struct subdev *dev[2];
     struct dai_buffer_format buffer_format[2];
     int buffer_id;
     volatile int cb_buf_index[2];
@@ -87,19 +106,22 @@ static void *iobuffers[2][2];
 static struct comarea *ca = NULL;
 static int n_devs[2] = { 0, 0 };
 static int n_fd_devs[2] = { 0, 0 };
-static fd_set dev_fds[2];
-static fd_set clocked_wfds;
 static int n_clocked_devs = 0;
-static int dev_fdn[2] = { 0, 0 };
 static int min_block_size[2] = { 0, 0 };
 static int cb_min_block_size[2] = { 0, 0 };
 static bool_t input_poll_mode = false;
 static struct subdev *dev[2][BF_MAXCHANNELS];
-static struct subdev *fd2dev[2][FD_SETSIZE];
 static struct subdev *ch2dev[2][BF_MAXCHANNELS];
 static int period_size;
 static int sample_rate;
 static int monitor_rate_fd = -1;
+#ifdef DAI_USE_EPOLL
+static int poll_timer_fd = -1;
+static int n_always_ready[2] = { 0, 0 };
+#else
+static struct subdev **pfd_dev[2];
+static int n_pfds[2];
+#endif
 static int synchpipe[2][2], paramspipe_s[2][2], paramspipe_r[2][2];
 static int cbpipe_s[2], cbpipe_r[2];
 static int cbmutex_pipe[2][2];
@@ -113,6 +135,242 @@ process_callback(void **state[2],
                  int frame_count,
                  int event);
     
+/*
+ * Waiting for devices. Each period, the devices that have data left to
+ * transfer are armed, and a device is disarmed when it has been reported
+ * ready, so it must be armed again if it still has data left after the
+ * transfer. The parameter pipe is always in the set.
+ */
+#ifdef DAI_USE_EPOLL
+
+static int
+ioready_fd(int io)
+{
+    static int epfd[2] = { -1, -1 };
+    struct epoll_event ev;
+
+    if (epfd[io] != -1) {
+        return epfd[io];
+    }
+    /* created in the process that waits, not shared over fork */
+    if ((epfd[io] = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        fprintf(stderr, "Failed to create epoll instance: %s.\n",
+                strerror(errno));
+        bf_exit(BF_EXIT_OTHER);
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epfd[io], EPOLL_CTL_ADD, paramspipe_s[io][0], &ev) == -1) {
+        fprintf(stderr, "epoll_ctl failed: %s.\n", strerror(errno));
+        bf_exit(BF_EXIT_OTHER);
+    }
+    if (io == IN && input_poll_mode) {
+        if ((poll_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+                                            TFD_CLOEXEC | TFD_NONBLOCK)) == -1)
+        {
+            fprintf(stderr, "Failed to create timer: %s.\n", strerror(errno));
+            bf_exit(BF_EXIT_OTHER);
+        }
+        ev.events = EPOLLIN;
+        ev.data.ptr = &poll_timer_fd;
+        if (epoll_ctl(epfd[io], EPOLL_CTL_ADD, poll_timer_fd, &ev) == -1) {
+            fprintf(stderr, "epoll_ctl failed: %s.\n", strerror(errno));
+            bf_exit(BF_EXIT_OTHER);
+        }
+    }
+    return epfd[io];
+}
+
+static void
+ioready_arm(int io,
+            struct subdev *sd)
+{
+    struct epoll_event ev;
+    int epfd;
+
+    if (sd->armed || sd->always_ready) {
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((io == IN) ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+    ev.data.ptr = sd;
+    epfd = ioready_fd(io);
+    if (epoll_ctl(epfd, sd->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                  sd->fd, &ev) == 0)
+    {
+        sd->registered = true;
+        sd->armed = true;
+        return;
+    }
+    if (sd->registered && (errno == ENOENT || errno == EPERM)) {
+        /* the registration is tied to the open file, and the I/O module may
+           have replaced the file behind the descriptor with dup2() */
+        epoll_ctl(epfd, EPOLL_CTL_DEL, sd->fd, NULL);
+        sd->registered = false;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, sd->fd, &ev) == 0) {
+            sd->registered = true;
+            sd->armed = true;
+            return;
+        }
+    }
+    if (!sd->registered && errno == EPERM) {
+        /* select() and poll() report these as always ready */
+        sd->always_ready = true;
+        n_always_ready[io]++;
+        return;
+    }
+    fprintf(stderr, "epoll_ctl failed: %s.\n", strerror(errno));
+    bf_exit(BF_EXIT_OTHER);
+}
+
+/* Wake up the next wait after 'usec' microseconds. */
+static void
+ioready_timeout(int64_t usec)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = usec / 1000000;
+    its.it_value.tv_nsec = (usec % 1000000) * 1000;
+    if (timerfd_settime(poll_timer_fd, 0, &its, NULL) == -1) {
+        fprintf(stderr, "Failed to set timer: %s.\n", strerror(errno));
+        bf_exit(BF_EXIT_OTHER);
+    }
+}
+
+static int
+ioready_wait(int io,
+             bool_t block,
+             struct subdev *ready[],
+             bool_t *params_ready)
+{
+    struct epoll_event events[n_devs[io] + 2];
+    struct subdev *sd;
+    uint64_t expirations;
+    int n, i, n_ready;
+
+    *params_ready = false;
+    if (n_always_ready[io] > 0 && block) {
+        /* don't block while an always ready device has data left */
+        for (i = 0; i < n_devs[io]; i++) {
+            sd = dev[io][i];
+            if (sd->always_ready && sd->pending && !sd->ready) {
+                block = false;
+                break;
+            }
+        }
+    }
+    while ((n = epoll_wait(ioready_fd(io), events, n_devs[io] + 2,
+                           block ? -1 : 0)) == -1 && errno == EINTR);
+    if (n == -1) {
+        fprintf(stderr, "epoll_wait failed: %s.\n", strerror(errno));
+        bf_exit(BF_EXIT_OTHER);
+    }
+    for (i = n_ready = 0; i < n; i++) {
+        if (events[i].data.ptr == NULL) {
+            *params_ready = true;
+        } else if (events[i].data.ptr == &poll_timer_fd) {
+            /* just woken up, clear the expiration */
+            while (read(poll_timer_fd, &expirations,
+                        sizeof(expirations)) == -1 && errno == EINTR);
+        } else {
+            sd = (struct subdev *)events[i].data.ptr;
+            sd->armed = false;
+            if (sd->pending) {
+                sd->ready = true;
+                ready[n_ready++] = sd;
+            }
+        }
+    }
+    if (n_always_ready[io] > 0) {
+        for (i = 0; i < n_devs[io]; i++) {
+            sd = dev[io][i];
+            if (sd->always_ready && sd->pending && !sd->ready) {
+                sd->ready = true;
+                ready[n_ready++] = sd;
+            }
+        }
+    }
+    return n_ready;
+}
+
+#else /* DAI_USE_EPOLL */
+
+static struct pollfd *
+ioready_fd(int io)
+{
+    static struct pollfd *pfds[2] = { NULL, NULL };
+    int n, i;
+
+    if (pfds[io] != NULL) {
+        return pfds[io];
+    }
+    /* the parameter pipe first, then the devices, initially disarmed */
+    pfds[io] = emalloc((n_devs[io] + 1) * sizeof(struct pollfd));
+    pfd_dev[io] = emalloc((n_devs[io] + 1) * sizeof(struct subdev *));
+    pfds[io][0].fd = paramspipe_s[io][0];
+    pfds[io][0].events = POLLIN;
+    pfd_dev[io][0] = NULL;
+    for (n = 0, i = 1; n < n_devs[io]; n++) {
+        if (dev[io][n]->fd < 0) {
+            continue;
+        }
+        pfds[io][i].fd = -1;
+        pfds[io][i].events = (io == IN) ? POLLIN : POLLOUT;
+        pfd_dev[io][i] = dev[io][n];
+        dev[io][n]->pfd_index = i++;
+    }
+    n_pfds[io] = i;
+    return pfds[io];
+}
+
+static void
+ioready_arm(int io,
+            struct subdev *sd)
+{
+    if (sd->armed) {
+        return;
+    }
+    ioready_fd(io)[sd->pfd_index].fd = sd->fd;
+    sd->armed = true;
+}
+
+static int
+ioready_wait(int io,
+             bool_t block,
+             struct subdev *ready[],
+             bool_t *params_ready)
+{
+    struct pollfd *pfds;
+    struct subdev *sd;
+    int n, i, n_ready;
+
+    pfds = ioready_fd(io);
+    while ((n = poll(pfds, n_pfds[io], block ? -1 : 0)) == -1 &&
+           errno == EINTR);
+    if (n == -1) {
+        fprintf(stderr, "poll failed: %s.\n", strerror(errno));
+        bf_exit(BF_EXIT_OTHER);
+    }
+    *params_ready = pfds[0].revents != 0;
+    for (i = 1, n_ready = 0; i < n_pfds[io]; i++) {
+        if (pfds[i].fd < 0 || pfds[i].revents == 0) {
+            continue;
+        }
+        sd = pfd_dev[io][i];
+        pfds[i].fd = -1;
+        sd->armed = false;
+        if (sd->pending) {
+            sd->ready = true;
+            ready[n_ready++] = sd;
+        }
+    }
+    return n_ready;
+}
+
+#endif /* DAI_USE_EPOLL */
+
 static void
 cbmutex(int io,
         bool_t lock)
@@ -158,13 +416,6 @@ update_devmap(int idx,
 {
     int n;
 
-    if (dev[io][idx]->fd >= 0) {
-        FD_SET(dev[io][idx]->fd, &dev_fds[io]);
-        if (dev[io][idx]->fd > dev_fdn[io]) {
-            dev_fdn[io] = dev[io][idx]->fd;
-        }
-        fd2dev[io][dev[io][idx]->fd] = dev[io][idx];
-    }
     for (n = 0; n < dev[io][idx]->channels.used_channels; n++) {
 	ch2dev[io][dev[io][idx]->channels.channel_name[n]] = dev[io][idx];
     }
@@ -192,27 +443,35 @@ update_delay(struct subdev *sd,
              int io,
              uint8_t *buf)
 {
+    void *bufs[sd->channels.used_channels];
+    int delays[sd->channels.used_channels];
     struct buffer_format *bf;
-    int n, newdelay, virtch;
+    int n, virtch, sample_spacing;
 
     if (sd->db == NULL) {
         return;
     }
+    sample_spacing = 1;
     for (n = 0; n < sd->channels.used_channels; n++) {
+        bufs[n] = NULL;
+        delays[n] = 0;
         if (sd->db[n] == NULL) {
             continue;
         }
         bf = &dai_buffer_format[io]->bf[sd->channels.channel_name[n]];
         virtch = bfconf->phys2virt[io][sd->channels.channel_name[n]][0];
-        newdelay = ca->delay[io][sd->channels.channel_name[n]];
+        bufs[n] = (void *)&buf[bf->byte_offset];
+        delays[n] = ca->delay[io][sd->channels.channel_name[n]];
         if (bfconf->use_subdelay[io] &&
             bfconf->subdelay[io][virtch] == BF_UNDEFINED_SUBDELAY)
         {
-            newdelay += bfconf->sdf_length;
+            delays[n] += bfconf->sdf_length;
         }
-        delay_update(sd->db[n], (void *)&buf[bf->byte_offset],
-                     bf->sf.bytes, bf->sample_spacing, newdelay, NULL);
+        /* the same for all channels of the subdevice */
+        sample_spacing = bf->sample_spacing;
     }
+    delay_update_channels(sd->db, bufs, sd->channels.used_channels,
+                          sd->channels.sf.bytes, sample_spacing, delays);
 }
 
 static void
@@ -225,8 +484,11 @@ allocate_delay_buffers(int io,
 		     sizeof(delaybuffer_t *));
     for (n = 0; n < sd->channels.used_channels; n++) {
 	/* check if we need a delay buffer here, that is if at least one
-	   channel has a direct virtual to physical mapping */
-	if (bfconf->n_virtperphys[io][sd->channels.channel_name[n]] == 1) {
+	   channel has a direct virtual to physical mapping, and delays are
+	   not ramped, which is done in the filter processes */
+	if (bfconf->n_virtperphys[io][sd->channels.channel_name[n]] == 1 &&
+            bfconf->delay_ramp == 0)
+        {
             virtch = bfconf->phys2virt[io][sd->channels.channel_name[n]][0];
             extra_delay = 0;
             if (bfconf->use_subdelay[io] &&
@@ -512,7 +774,6 @@ init_output(struct dai_subdevice *subdev,
         n_fd_devs[OUT]++;
         dev[OUT][idx]->fd = fd;
         if (dev[OUT][idx]->uses_clock) {
-            FD_SET(dev[OUT][idx]->fd, &clocked_wfds);
             n_clocked_devs++;
         }
         if (dev[OUT][idx]->uses_clock &&
@@ -744,6 +1005,35 @@ callback_process(int n_subdevs[2],
     while (true) sleep(1000);
 }
 
+#define COMAREA_CARVE(member, count)                                           \
+    if (base != NULL) {                                                        \
+        c->member = (void *)&base[size];                                       \
+    }                                                                          \
+    size += ((count) * sizeof(*c->member) + ALIGNMENT - 1) &                   \
+        ~(ALIGNMENT - 1);
+
+/* Lay out the comarea arrays after the struct. If 'base' is NULL, only the
+   total size is calculated. */
+static size_t
+comarea_layout(uint8_t *base,
+               int n_subdevs[2])
+{
+    struct comarea *c;
+    size_t size;
+
+    c = (struct comarea *)base;
+    size = (sizeof(struct comarea) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    FOR_IN_AND_OUT {
+        COMAREA_CARVE(is_muted[IO], bfconf->n_physical_channels[IO]);
+        COMAREA_CARVE(delay[IO], bfconf->n_physical_channels[IO]);
+        COMAREA_CARVE(dev[IO], n_subdevs[IO]);
+        COMAREA_CARVE(buffer_format[IO].bf, bfconf->n_physical_channels[IO]);
+    }
+    return size;
+}
+
+#undef COMAREA_CARVE
+
 bool_t
 dai_init(int _period_size,
 	 int rate,
@@ -754,23 +1044,23 @@ dai_init(int _period_size,
     bool_t all_bad_alignment, none_clocked;
     uint8_t *buffer;
     char dummy = 0;
+    size_t size;
     int n;
     pid_t pid;
 
-    memset(dev_fds, 0, sizeof(dev_fds));
-    memset(&clocked_wfds, 0, sizeof(clocked_wfds));
-    memset(fd2dev, 0, sizeof(fd2dev));
     memset(ch2dev, 0, sizeof(ch2dev));
     
     period_size = _period_size;
     sample_rate = rate;
 
     /* allocate shared memory for interprocess communication */
-    if ((ca = shmalloc(sizeof(struct comarea))) == NULL) {
+    size = comarea_layout(NULL, n_subdevs);
+    if ((ca = shmalloc(size)) == NULL) {
 	fprintf(stderr, "Failed to allocate shared memory.\n");
 	return false;
     }
-    memset(ca, 0, sizeof(struct comarea));
+    memset(ca, 0, size);
+    comarea_layout((uint8_t *)ca, n_subdevs);
     ca->frames_left = -1;
     ca->cb_frames_left = -1;
     FOR_IN_AND_OUT {
@@ -875,6 +1165,8 @@ dai_init(int _period_size,
     }
     memset(buffer, 0, 2 * dai_buffer_format[IN]->n_bytes +
            2 * dai_buffer_format[OUT]->n_bytes);
+    emalloc_account(EMALLOC_CAT_IOBUFS, 2 * dai_buffer_format[IN]->n_bytes +
+                    2 * dai_buffer_format[OUT]->n_bytes);
     FOR_IN_AND_OUT {
         iobuffers[IO][0] = buffer;
         buffer += dai_buffer_format[IO]->n_bytes;
@@ -984,7 +1276,9 @@ void
 dai_toggle_mute(int io,
 		int channel)
 {
-    if ((io != IN && io != OUT) || channel < 0 || channel >= BF_MAXCHANNELS) {
+    if ((io != IN && io != OUT) || channel < 0 ||
+        channel >= bfconf->n_physical_channels[io])
+    {
 	return;
     }
     ca->is_muted[io][channel] = !ca->is_muted[io][channel];
@@ -995,8 +1289,8 @@ dai_change_delay(int io,
 		 int channel,
 		 int delay)
 {
-    if (delay < 0 || channel < 0 || channel >= BF_MAXCHANNELS ||
-        (io != IN && io != OUT) ||
+    if (delay < 0 || (io != IN && io != OUT) || channel < 0 ||
+        channel >= bfconf->n_physical_channels[io] ||
         bfconf->n_virtperphys[io][channel] != 1)
     {
 	return -1;
@@ -1127,14 +1421,16 @@ dai_input(volatile struct debug_input dbg[],
     static int buf_index = 0, frames = 0, curbuf = 0;
     static struct timeval starttv;
 
-    int fdn, fdmax, n, i, k, fd, devsleft, frames_left = 0, dbg_pos = 0;
-    struct timeval tv, zerotv, *ptv;
+    int n_ready, r, n, i, k, fd, devsleft, frames_left = 0, dbg_pos = 0;
+    struct subdev *ready[n_devs[IN] > 0 ? n_devs[IN] : 1];
+    struct timeval tv;
     struct subdev *sd = NULL;
     double measured_rate;
-    fd_set rfds, readfds;
     int64_t usec, usec2;
+#ifndef DAI_USE_EPOLL
     struct timespec ts;
-    bool_t firstloop;
+#endif
+    bool_t firstloop, block, params_ready;
     uint8_t *buf;
     int minleft;
 
@@ -1142,8 +1438,6 @@ dai_input(volatile struct debug_input dbg[],
     curbuf = !curbuf;
     
     *dbg_loops = 0;
-    zerotv.tv_sec = 0;
-    zerotv.tv_usec = 0;
     firstloop = true;
     minleft = period_size;
     if ((ca->frames_left != -1 &&
@@ -1161,7 +1455,12 @@ dai_input(volatile struct debug_input dbg[],
 	while (true) sleep(100000);
     }
     devsleft = n_fd_devs[IN];
-    memcpy(&rfds, &dev_fds[IN], sizeof(fd_set));
+    for (n = 0; n < n_devs[IN]; n++) {
+        if (dev[IN][n]->fd >= 0) {
+            dev[IN][n]->pending = true;
+            ioready_arm(IN, dev[IN][n]);
+        }
+    }
 
     if (isfirst) {
 	ca->pid[IN] = getpid();
@@ -1185,16 +1484,12 @@ dai_input(volatile struct debug_input dbg[],
         
     }
     while (devsleft != 0) {
-	memcpy(&readfds, &rfds, sizeof(fd_set));
-	FD_SET(paramspipe_s[IN][0], &readfds);
-
-        fdmax = (dev_fdn[IN] > paramspipe_s[IN][0]) ? dev_fdn[IN] :
-            paramspipe_s[IN][0];
-
-        dbg[dbg_pos].select.fdmax = fdmax;
+        dbg[dbg_pos].select.devsleft = devsleft;
         timestamp(&dbg[dbg_pos].select.ts_call);
         
+        block = true;
         if (input_poll_mode) {
+            block = false;
             if (!firstloop) {
                 usec = (int64_t)minleft * 1000000 / (int64_t)sample_rate;
                 if (min_block_size[IN] > 0) {
@@ -1204,6 +1499,13 @@ dai_input(volatile struct debug_input dbg[],
                         usec = usec2;
                     }
                 }
+#ifdef DAI_USE_EPOLL
+                /* the timer wakes up the wait, or any device before it */
+                if (usec > 50) {
+                    ioready_timeout(usec - 50);
+                    block = true;
+                }
+#else
                 /* nanosleep sleeps precise in maximum 2 ms */
                 if (usec > 40000) {
                     ts.tv_sec = 0;
@@ -1222,42 +1524,34 @@ dai_input(volatile struct debug_input dbg[],
                     ts.tv_nsec = (usec - 50) * 1000;
                     nanosleep(&ts, NULL);
                 }
+#endif
             }
-            ptv = &zerotv;
-        } else {
-            ptv = NULL;
         }
 
-        while ((fdn = select(fdmax + 1, &readfds, NULL, NULL, ptv)) == -1 &&
-               errno == EINTR);
+        n_ready = ioready_wait(IN, block, ready, &params_ready);
         
         timestamp(&dbg[dbg_pos].select.ts_ret);
-        dbg[dbg_pos].select.retval = fdn;
-    
-	if (fdn == -1) {
-	    fprintf(stderr, "Select failed: %s.\n", strerror(errno));
-	    bf_exit(BF_EXIT_OTHER);
-	}
+        dbg[dbg_pos].select.retval = n_ready + params_ready;
+
+        if (params_ready) {
+            handle_params(IN);
+        }
 
+        /* devices that cannot be waited for are read anyway */
         for (n = 0; n < n_devs[IN]; n++) {
-            if (dev[IN][n]->uses_clock && !dev[IN][n]->uses_callback &&
-                !FD_ISSET(dev[IN][n]->fd, &readfds))
+            sd = dev[IN][n];
+            if (sd->uses_clock && !sd->uses_callback && sd->pending &&
+                !sd->ready && (input_poll_mode || sd->bad_alignment))
             {
-                if (input_poll_mode || dev[IN][n]->bad_alignment) {
-                    FD_SET(dev[IN][n]->fd, &readfds);
-                    fdn++;
-                }
+                sd->ready = true;
+                ready[n_ready++] = sd;
             }
         }
 	
-	fd = -1;
-	while (fdn--) {
-            for (fd++; !FD_ISSET(fd, &readfds) && fd <= fdmax; fd++);
-	    if (fd == paramspipe_s[IN][0]) {
-		handle_params(IN);
-		continue;
-	    }
-	    sd = fd2dev[IN][fd];
+	for (r = 0; r < n_ready; r++) {
+            sd = ready[r];
+            sd->ready = false;
+            fd = sd->fd;
 
             dbg[dbg_pos].read.fd = fd;
             dbg[dbg_pos].read.buf = buf + sd->buf_offset;
@@ -1320,7 +1614,7 @@ dai_input(volatile struct debug_input dbg[],
 		    }
 		}
 		devsleft--;
-		FD_CLR(fd, &rfds);
+		sd->pending = false;
 		
 		frames_left = (sd->buf_size - sd->buf_left) /
 		    sd->channels.sf.bytes / sd->channels.open_channels;
@@ -1373,10 +1667,13 @@ dai_input(volatile struct debug_input dbg[],
 		if (sd->buf_left == 0) {
 		    sd->buf_left = sd->buf_size;
 		    devsleft--;
-		    FD_CLR(fd, &rfds);		
+		    sd->pending = false;
 		}
 		break;
 	    }
+            if (sd->pending) {
+                ioready_arm(IN, sd);
+            }
 	}
         firstloop = false;
     }
@@ -1406,12 +1703,12 @@ dai_output(bool_t iodelay_fill,
     static bool_t islast = false;
     static int buf_index = 0;
     static int curbuf = 0;
-    static fd_set readfds;
     
-    int devsleft, fdn, fd, n, frames_left;    
+    int devsleft, n_ready, r, fd, n, frames_left;    
     uint8_t *buf, dummydata[1] = { '\0' };
-    fd_set wfds, writefds;
+    struct subdev *ready[n_devs[OUT] > 0 ? n_devs[OUT] : 1];
     struct subdev *sd;
+    bool_t params_ready;
     int dbg_pos = 0;
 
     buf = (uint8_t *)iobuffers[OUT][curbuf];
@@ -1436,10 +1733,6 @@ dai_output(bool_t iodelay_fill,
 	}
         islast = true;
     }
-    if (isfirst) {
-	FD_ZERO(&readfds);
-    }
-
     for (n = 0; n < n_devs[OUT]; n++) {
         if (dev[OUT][n]->uses_callback) {
             continue;
@@ -1447,42 +1740,33 @@ dai_output(bool_t iodelay_fill,
         update_delay(dev[OUT][n], OUT, buf);
     }
     
-    if (iodelay_fill) {
-        memcpy(&wfds, &clocked_wfds, sizeof(fd_set));
-        devsleft = n_clocked_devs;
-    } else {
-        devsleft = n_fd_devs[OUT];
-        memcpy(&wfds, &dev_fds[OUT], sizeof(fd_set));
+    /* only clocked devices are filled with the I/O-delay */
+    for (n = devsleft = 0; n < n_devs[OUT]; n++) {
+        sd = dev[OUT][n];
+        if (sd->fd >= 0 && (!iodelay_fill || sd->uses_clock)) {
+            sd->pending = true;
+            ioready_arm(OUT, sd);
+            devsleft++;
+        }
     }
 
     while (devsleft != 0) {
-	memcpy(&writefds, &wfds, sizeof(fd_set));
-	FD_SET(paramspipe_s[OUT][0], &readfds);
-        fdn = (dev_fdn[OUT] > paramspipe_s[OUT][0]) ? dev_fdn[OUT] :
-            paramspipe_s[OUT][0];
-        
-        dbg[dbg_pos].select.fdmax = fdn + 1;
+        dbg[dbg_pos].select.devsleft = devsleft;
         timestamp(&dbg[dbg_pos].select.ts_call);
         
-	while ((fdn = select(fdn + 1, &readfds, &writefds, NULL, NULL)) == -1 &&
-               errno == EINTR);
+        n_ready = ioready_wait(OUT, true, ready, &params_ready);
         
         timestamp(&dbg[dbg_pos].select.ts_ret);
-        dbg[dbg_pos].select.retval = fdn;
+        dbg[dbg_pos].select.retval = n_ready + params_ready;
         
-	if (fdn == -1) {
-	    fprintf(stderr, "Select failed: %s.\n", strerror(errno));
-	    bf_exit(BF_EXIT_OTHER);
-	}
-        if (FD_ISSET(paramspipe_s[OUT][0], &readfds)) {
+        if (params_ready) {
             handle_params(OUT);
-            fdn--;
         }
         
-	fd = -1;
-	while (fdn--) {
-            for (fd++; !FD_ISSET(fd, &writefds) && fd <= dev_fdn[OUT]; fd++);
-	    sd = fd2dev[OUT][fd];
+	for (r = 0; r < n_ready; r++) {
+            sd = ready[r];
+            sd->ready = false;
+            fd = sd->fd;
 	    if (sd->block_size > 0 && sd->buf_left > sd->block_size) {
 		n = sd->block_size + sd->buf_left % sd->block_size;
 	    } else {
@@ -1535,8 +1819,10 @@ dai_output(bool_t iodelay_fill,
 	    if (sd->buf_left == 0) {
 		sd->buf_left = sd->buf_size;
 		devsleft--;
-		FD_CLR(fd, &wfds);
-	    }
+		sd->pending = false;
+	    } else {
+                ioready_arm(OUT, sd);
+            }
 	}
         if (synch_fd != -1) {
             timestamp(&dbg[0].init.ts_synchfd_call);
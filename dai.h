@@ -62,7 +62,8 @@ struct dai_buffer_format {
     int n_bytes;
     int n_samples;
     int n_channels;
-    struct buffer_format bf[BF_MAXCHANNELS];
+    /* one per physical channel */
+    struct buffer_format *bf;
 };
 
 extern struct dai_buffer_format *dai_buffer_format[2];
@@ -73,7 +74,7 @@ struct debug_input {
         uint64_t ts_start_ret;
     } init;
     struct {
-        int fdmax;
+        int devsleft; /* devices waited for */
         int retval;
         uint64_t ts_call;
         uint64_t ts_ret;
@@ -97,7 +98,7 @@ struct debug_output {
         uint64_t ts_start_ret;
     } init;
     struct {
-        int fdmax;
+        int devsleft; /* devices waited for */
         int retval;
         uint64_t ts_call;
         uint64_t ts_ret;
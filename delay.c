@@ -19,6 +19,8 @@
 #include "convolver.h"
 #include "timestamp.h"
 
+#define ALIGNED_SIZE(size) (((size) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
 static int realsize;
 static int subdelay_filter_length;
 static td_conv_t **subdelay_filter = NULL;
@@ -31,14 +33,9 @@ struct _delaybuffer_t_ {
     int maxdelay;    /* maximum allowable delay, or negative if delay cannot be
 			changed in runtime */
     int curdelay;    /* current delay */
-    int curbuf;      /* index of current full-sized buffer */
-    int n_fbufs;     /* number of full-sized buffers currently used */
-    int n_fbufs_cap; /* number of full-sized buffers allocated */
-    void **fbufs;    /* full-sized buffers */
-    int n_rest;      /* samples in rest buffer */
-    void *rbuf;      /* rest buffer */
-    void *shortbuf[2]; /* pointers to buffers which fit the whole delay, only
-                          used when delay is <= fragment size */
+    int size;        /* ring size in samples, a multiple of fragsize */
+    int wpos;        /* write position in the ring, at a block boundary */
+    uint8_t *ring;   /* ring buffer, followed by a copy of its first block */
 };
 
 static double
@@ -73,49 +70,63 @@ sample_sinc(int half_length,
     return filter;
 }
 
+/* Copy 'n_frames' samples of each channel, from strided 'src' to contiguous
+   'dst'. All channels are done in one pass over the source, which is the
+   order interleaved buffers are laid out in memory. */
 static void
-copy_to_delaybuf(void *dbuf,
-		 void *buf,
-		 int sample_size,
-		 int sample_spacing,
-		 int n_samples)
+gather_frames(uint8_t *dst[],
+              uint8_t *src[],
+              int n_channels,
+              int sample_size,
+              int sample_spacing,
+              int n_frames)
 {
-    int n, i;
-    
+    int n, i, c;
+
     if (sample_spacing == 1) {
-	memcpy(dbuf, buf, n_samples * sample_size);
-	return;
+        for (c = 0; c < n_channels; c++) {
+            memcpy(dst[c], src[c], n_frames * sample_size);
+        }
+        return;
     }
-    
+
     switch (sample_size) {
     case 1:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint8_t *)dbuf)[n] = ((uint8_t *)buf)[i];
-	}	
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                dst[c][n] = src[c][i];
+            }
+	}
 	break;
     case 2:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint16_t *)dbuf)[n] = ((uint16_t *)buf)[i];
-	}	
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                ((uint16_t *)dst[c])[n] = ((uint16_t *)src[c])[i];
+            }
+	}
 	break;
     case 3:
-	n_samples *= 3;
-	sample_spacing = sample_spacing * 3 - 3;
-	for (n = i = 0; n < n_samples; i += sample_spacing) {
-	    ((uint8_t *)dbuf)[n++] = ((uint8_t *)buf)[i++];
-	    ((uint8_t *)dbuf)[n++] = ((uint8_t *)buf)[i++];
-	    ((uint8_t *)dbuf)[n++] = ((uint8_t *)buf)[i++];
-	}	
+	for (n = i = 0; n < 3 * n_frames; n += 3, i += 3 * sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                dst[c][n] = src[c][i];
+                dst[c][n+1] = src[c][i+1];
+                dst[c][n+2] = src[c][i+2];
+            }
+	}
 	break;
     case 4:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint32_t *)dbuf)[n] = ((uint32_t *)buf)[i];
-	}		
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                ((uint32_t *)dst[c])[n] = ((uint32_t *)src[c])[i];
+            }
+	}
 	break;
     case 8:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint64_t *)dbuf)[n] = ((uint64_t *)buf)[i];
-	}		
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                ((uint64_t *)dst[c])[n] = ((uint64_t *)src[c])[i];
+            }
+	}
 	break;
     default:
 	fprintf(stderr, "Sample byte size %d not suppported.\n", sample_size);
@@ -124,197 +135,125 @@ copy_to_delaybuf(void *dbuf,
     }
 }
 
+/* The reverse of gather_frames(), from contiguous 'src' to strided 'dst'. */
 static void
-copy_from_delaybuf(void *buf,
-		   void *dbuf,		   
-		   int sample_size,
-		   int sample_spacing,
-		   int n_samples)
+scatter_frames(uint8_t *dst[],
+               uint8_t *src[],
+               int n_channels,
+               int sample_size,
+               int sample_spacing,
+               int n_frames)
 {
-    int n, i;
+    int n, i, c;
 
     if (sample_spacing == 1) {
-	memcpy(buf, dbuf, n_samples * sample_size);
-	return;
-    }
-    
-    switch (sample_size) {
-    case 1:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint8_t *)buf)[i] = ((uint8_t *)dbuf)[n];
-	}	
-	break;
-    case 2:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint16_t *)buf)[i] = ((uint16_t *)dbuf)[n];
-	}	
-	break;
-    case 3:
-	n_samples *= 3;
-	sample_spacing = sample_spacing * 3 - 3;
-	for (n = i = 0; n < n_samples; i += sample_spacing) {
-	    ((uint8_t *)buf)[i++] = ((uint8_t *)dbuf)[n++];
-	    ((uint8_t *)buf)[i++] = ((uint8_t *)dbuf)[n++];
-	    ((uint8_t *)buf)[i++] = ((uint8_t *)dbuf)[n++];
-	}	
-	break;
-    case 4:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint32_t *)buf)[i] = ((uint32_t *)dbuf)[n];
-	}		
-	break;
-    case 8:
-	for (n = i = 0; n < n_samples; n++, i += sample_spacing) {
-	    ((uint64_t *)buf)[i] = ((uint64_t *)dbuf)[n];
-	}		
-	break;
-    default:
-	fprintf(stderr, "Sample byte size %d not suppported.\n", sample_size);
-	bf_exit(BF_EXIT_OTHER);
-	break;
+        for (c = 0; c < n_channels; c++) {
+            memcpy(dst[c], src[c], n_frames * sample_size);
+        }
+        return;
     }
-}
-
-static void
-shift_samples(void *buf,
-	      int sample_size,
-	      int sample_spacing,
-	      int n_samples,
-	      int distance)
-{
-    int n, i;
 
-    n = (n_samples - 1) * sample_spacing;
-    i = (n_samples + distance - 1) * sample_spacing;
     switch (sample_size) {
     case 1:
-	for (; n >= 0; n -= sample_spacing, i -= sample_spacing) {
-	    ((uint8_t *)buf)[i] = ((uint8_t *)buf)[n];
-	}	
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                dst[c][i] = src[c][n];
+            }
+	}
 	break;
     case 2:
-	for (; n >= 0; n -= sample_spacing, i -= sample_spacing) {
-	    ((uint16_t *)buf)[i] = ((uint16_t *)buf)[n];
-	}	
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                ((uint16_t *)dst[c])[i] = ((uint16_t *)src[c])[n];
+            }
+	}
 	break;
     case 3:
-	n *= 3;
-	i *= 3;
-	sample_spacing *= 3;
-	for (; n >= 0; n -= sample_spacing, i -= sample_spacing) {
-	    ((uint8_t *)buf)[i++] = ((uint8_t *)buf)[n++];
-	    ((uint8_t *)buf)[i++] = ((uint8_t *)buf)[n++];
-	    ((uint8_t *)buf)[i++] = ((uint8_t *)buf)[n++];
-	}	
+	for (n = i = 0; n < 3 * n_frames; n += 3, i += 3 * sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                dst[c][i] = src[c][n];
+                dst[c][i+1] = src[c][n+1];
+                dst[c][i+2] = src[c][n+2];
+            }
+	}
 	break;
     case 4:
-	for (; n >= 0; n -= sample_spacing, i -= sample_spacing) {
-	    ((uint32_t *)buf)[i] = ((uint32_t *)buf)[n];
-	}	
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                ((uint32_t *)dst[c])[i] = ((uint32_t *)src[c])[n];
+            }
+	}
 	break;
     case 8:
-	for (; n >= 0; n -= sample_spacing, i -= sample_spacing) {
-	    ((uint64_t *)buf)[i] = ((uint64_t *)buf)[n];
-	}	
+	for (n = i = 0; n < n_frames; n++, i += sample_spacing) {
+            for (c = 0; c < n_channels; c++) {
+                ((uint64_t *)dst[c])[i] = ((uint64_t *)src[c])[n];
+            }
+	}
 	break;
     default:
 	fprintf(stderr, "Sample byte size %d not suppported.\n", sample_size);
 	bf_exit(BF_EXIT_OTHER);
 	break;
-    }    
-}
-
-static void
-update_delay_buffer(delaybuffer_t *db,
-		    int sample_size,
-		    int sample_spacing,
-		    uint8_t *buf)
-{
-    uint8_t *lastbuf;
-
-    lastbuf = (db->curbuf == db->n_fbufs - 1) ? db->fbufs[0] :
-	db->fbufs[db->curbuf + 1];
-
-    /* 1. copy buffer to current full-sized delay buffer */
-    copy_to_delaybuf(db->fbufs[db->curbuf], buf, sample_size,
-		     sample_spacing, db->fragsize);
-    
-    if (db->n_rest != 0) {
-	/* 2. copy from delay rest buffer to the start of buffer */
-	copy_from_delaybuf(buf, db->rbuf, sample_size, sample_spacing,
-			   db->n_rest);
-    
-	/* 3. copy from end of last full-sized delay buffer to rest buffer */
-	memcpy(db->rbuf, lastbuf + (db->fragsize - db->n_rest) * sample_size,
-	       db->n_rest * sample_size);
-    }
-
-    /* 4. copy from start of last full-sized buffer to end of buffer */
-    copy_from_delaybuf(buf + db->n_rest * sample_size * sample_spacing,
-		       lastbuf, sample_size, sample_spacing,
-		       db->fragsize - db->n_rest);
-    
-    if (++db->curbuf == db->n_fbufs) {
-	db->curbuf = 0;
     }
 }
 
-static void
-update_delay_short_buffer(delaybuffer_t *db,
-			  int sample_size,
-			  int sample_spacing,
-			  uint8_t *buf)
-{
-    copy_to_delaybuf(db->shortbuf[db->curbuf], 
-		     buf + (db->fragsize - db->n_rest) * sample_size *
-		     sample_spacing, sample_size, sample_spacing,
-		     db->n_rest);
-
-    shift_samples(buf, sample_size, sample_spacing,
-		  db->fragsize - db->n_rest, db->n_rest);
-    
-    db->curbuf = !db->curbuf;
-    copy_from_delaybuf(buf, db->shortbuf[db->curbuf], sample_size,
-		       sample_spacing, db->n_rest);
-}
-
 static void
 change_delay(delaybuffer_t *db,
 	     int sample_size,
 	     int newdelay)
 {
-    int size, i;
-
     if (newdelay == db->curdelay || newdelay > db->maxdelay) {
 	return;
     }
-    if (newdelay <= db->fragsize) {
-	db->n_rest = newdelay;
-	size = newdelay * sample_size;
-	if (db->curdelay > db->fragsize || db->curdelay < newdelay) {
-	    memset(db->shortbuf[0], 0, size);
-	    memset(db->shortbuf[1], 0, size);
-	}
-	db->n_fbufs = 0;
-	db->curbuf = 0;
-	db->curdelay = newdelay;
-	return;
+    if (newdelay > db->curdelay) {
+        /* the samples between the old and new delay are not in the ring, so
+           start over with silence */
+        memset(db->ring, 0, (db->size + db->fragsize) * sample_size);
     }
-    db->n_rest = newdelay % db->fragsize;
-    db->n_fbufs = newdelay / db->fragsize + 1;
-    size = db->fragsize * sample_size;
-    if (db->curdelay < newdelay) {
-	for (i = 0; i < db->n_fbufs; i++) {
-	    memset(db->fbufs[i], 0, size);
-	}
-	if (db->n_rest != 0) {
-	    memset(db->rbuf, 0, db->n_rest * sample_size);
-	}
-    }
-    db->curbuf = 0;
     db->curdelay = newdelay;
 }
 
+/* Write one block of each channel into its ring and read the delayed block
+   back. 'src' and 'dst' may be the same. Only channels with a non-zero delay
+   may be given. */
+static void
+update_channels(delaybuffer_t *db[],
+                uint8_t *src[],
+                uint8_t *dst[],
+                int n_channels,
+                int sample_size,
+                int src_spacing,
+                int dst_spacing)
+{
+    uint8_t *wptr[n_channels], *rptr[n_channels];
+    int c, rpos;
+
+    for (c = 0; c < n_channels; c++) {
+        wptr[c] = db[c]->ring + db[c]->wpos * sample_size;
+    }
+    gather_frames(wptr, src, n_channels, sample_size, src_spacing,
+                  db[0]->fragsize);
+    for (c = 0; c < n_channels; c++) {
+        if (db[c]->wpos == 0) {
+            /* keep the copy of the first block after the end up to date, so
+               reads crossing the end of the ring are contiguous */
+            memcpy(db[c]->ring + db[c]->size * sample_size, db[c]->ring,
+                   db[c]->fragsize * sample_size);
+        }
+        rpos = db[c]->wpos - db[c]->curdelay;
+        if (rpos < 0) {
+            rpos += db[c]->size;
+        }
+        rptr[c] = db[c]->ring + rpos * sample_size;
+        if ((db[c]->wpos += db[c]->fragsize) == db[c]->size) {
+            db[c]->wpos = 0;
+        }
+    }
+    scatter_frames(dst, rptr, n_channels, sample_size, dst_spacing,
+                   db[0]->fragsize);
+}
+
 void
 delay_update(delaybuffer_t *db,
 	     void *buf,	     
@@ -323,17 +262,52 @@ delay_update(delaybuffer_t *db,
 	     int delay,
 	     void *optional_target_buf)
 {
+    uint8_t *src = buf, *dst = buf;
+
     change_delay(db, sample_size, delay);
+    if (db->curdelay == 0) {
+        if (optional_target_buf != NULL) {
+            dst = optional_target_buf;
+            gather_frames(&dst, &src, 1, sample_size, sample_spacing,
+                          db->fragsize);
+        }
+        return;
+    }
     if (optional_target_buf != NULL) {
-	copy_to_delaybuf(optional_target_buf, buf, sample_size, sample_spacing,
-			 db->fragsize);
-	buf = optional_target_buf;
-	sample_spacing = 1;
+        dst = optional_target_buf;
+        update_channels(&db, &src, &dst, 1, sample_size, sample_spacing, 1);
+    } else {
+        update_channels(&db, &src, &dst, 1, sample_size, sample_spacing,
+                        sample_spacing);
     }
-    if (db->n_fbufs > 0) {
-	update_delay_buffer(db, sample_size, sample_spacing, buf);
-    } else if (db->n_rest > 0) {
-	update_delay_short_buffer(db, sample_size, sample_spacing, buf);
+}
+
+void
+delay_update_channels(delaybuffer_t *db[],
+                      void *bufs[],
+                      int n_channels,
+                      int sample_size,
+                      int sample_spacing,
+                      const int delays[])
+{
+    delaybuffer_t *active_db[n_channels];
+    uint8_t *active_bufs[n_channels];
+    int n, n_active;
+
+    for (n = n_active = 0; n < n_channels; n++) {
+        if (db[n] == NULL) {
+            continue;
+        }
+        change_delay(db[n], sample_size, delays[n]);
+        if (db[n]->curdelay != 0) {
+            active_db[n_active] = db[n];
+            active_bufs[n_active] = bufs[n];
+            n_active++;
+        }
+    }
+    if (n_active > 0) {
+        update_channels(active_db, active_bufs, active_bufs, n_active,
+                        sample_size, sample_spacing, sample_spacing);
     }
 }
 
@@ -343,9 +317,9 @@ delay_allocate_buffer(int fragment_size,
 		      int maxdelay,
 		      int sample_size)
 {
+    struct earena *arena;
     delaybuffer_t *db;
-    int n, delay;
-    int size;
+    int delay, size;
 
     /* if maxdelay is negative, no delay changing will be allowed, thus
        memory need only to be allocated for the current delay */
@@ -362,46 +336,14 @@ delay_allocate_buffer(int fragment_size,
     if (delay == 0) {
 	return db;
     }
-    if (delay <= fragment_size) {
-	/* optimise for short delay */
-	db->n_rest = initdelay; /* current value */
-	size = delay * sample_size;
-	db->shortbuf[0] = emallocaligned(size);
-	db->shortbuf[1] = emallocaligned(size);
-	memset(db->shortbuf[0], 0, size);
-	memset(db->shortbuf[1], 0, size);
-	return db;
-    }
-    if (maxdelay > 0) {
-	/* allocate full-length short buffers to keep this option if the
-	   delay is reduced in run-time */
-	size = fragment_size * sample_size;
-	db->shortbuf[0] = emallocaligned(size);
-	db->shortbuf[1] = emallocaligned(size);
-	memset(db->shortbuf[0], 0, size);
-	memset(db->shortbuf[1], 0, size);
-    }
-    
-    db->n_rest = initdelay % fragment_size;
-    db->n_fbufs = initdelay / fragment_size + 1;
-    if (db->n_fbufs == 1) {
-	db->n_fbufs = 0;
-    }
-    db->n_fbufs_cap = delay / fragment_size + 1;
-    db->fbufs = emalloc(db->n_fbufs_cap * sizeof(void *));
-    size = fragment_size * sample_size;
-    for (n = 0; n < db->n_fbufs_cap; n++) {
-	db->fbufs[n] = emallocaligned(size);
-	memset(db->fbufs[n], 0, size);
-    }
-    if (maxdelay > 0) {
-	db->rbuf = emallocaligned(size);
-	memset(db->rbuf, 0, size);
-    } else if (db->n_rest != 0) {
-	size = db->n_rest * sample_size;
-	db->rbuf = emallocaligned(size);
-	memset(db->rbuf, 0, size);
-    }
+
+    /* whole blocks, so that writes never wrap, and room for the delay plus
+       the block being written */
+    db->size = (delay + 2 * fragment_size - 1) / fragment_size * fragment_size;
+    size = ALIGNED_SIZE((db->size + fragment_size) * sample_size);
+    arena = earena_new(size, EMALLOC_CAT_DELAY);
+    db->ring = earena_alloc(arena, size);
+    memset(db->ring, 0, size);
     return db;
 }
 
@@ -503,3 +445,138 @@ delay_subsample_init(int step_count,
           2 * step_count - 1, subdelay_filter_length, kaiser_beta);
     return true;
 }
+
+struct _vardelay_t_ {
+    int fragsize;      /* fragment size */
+    int maxdelay;      /* maximum allowable delay */
+    int ramp_length;   /* number of samples a delay change is spread over */
+    int realsize;
+    uint32_t mask;     /* ring size minus one, the size is a power of two */
+    uint32_t wpos;     /* total number of samples written */
+    int target;        /* delay to ramp to */
+    double curdelay;   /* current, possibly fractional, delay */
+    double step;       /* delay change per sample while ramping */
+    void *ring;
+};
+
+/* Interpolate between the ring samples at 'k' and 'k + 1', 'mu' from the
+   former. Cubic Lagrange in Farrow form, which needs the sample after next,
+   or linear if 'k + 2' has not been written yet. */
+#define VARDELAY_INTERPOLATE(type, ring, mask, k, mu, cubic, y)               \
+    do {                                                                      \
+        double xm1_, x0_, x1_, x2_, c1_, c2_, c3_;                            \
+        x0_ = (double)((type *)(ring))[(k) & (mask)];                         \
+        x1_ = (double)((type *)(ring))[((k) + 1) & (mask)];                   \
+        if (cubic) {                                                          \
+            xm1_ = (double)((type *)(ring))[((k) - 1) & (mask)];              \
+            x2_ = (double)((type *)(ring))[((k) + 2) & (mask)];               \
+            c1_ = x1_ - xm1_ / 3.0 - 0.5 * x0_ - x2_ / 6.0;                   \
+            c2_ = 0.5 * (xm1_ + x1_) - x0_;                                   \
+            c3_ = (x2_ - xm1_) / 6.0 + 0.5 * (x0_ - x1_);                     \
+            y = (type)(((c3_ * (mu) + c2_) * (mu) + c1_) * (mu) + x0_);       \
+        } else {                                                              \
+            y = (type)(x0_ + (mu) * (x1_ - x0_));                             \
+        }                                                                     \
+    } while (0)
+
+static void
+vardelay_ramp(vardelay_t *vd,
+              void *buf)
+{
+    uint32_t w, k;
+    double d, mu;
+    int n, id;
+
+    for (n = 0; n < vd->fragsize; n++) {
+        d = vd->curdelay;
+        id = (int)floor(d);
+        mu = d - (double)id;
+        w = vd->wpos + (uint32_t)n;
+        if (mu == 0.0) {
+            k = w - (uint32_t)id;
+        } else {
+            /* between the samples 'id + 1' and 'id' back */
+            k = w - (uint32_t)id - 1;
+            mu = 1.0 - mu;
+        }
+        if (vd->realsize == 4) {
+            VARDELAY_INTERPOLATE(float, vd->ring, vd->mask, k, mu, d > 1.0,
+                                 ((float *)buf)[n]);
+        } else {
+            VARDELAY_INTERPOLATE(double, vd->ring, vd->mask, k, mu, d > 1.0,
+                                 ((double *)buf)[n]);
+        }
+        vd->curdelay += vd->step;
+        if ((vd->step > 0.0 && vd->curdelay >= (double)vd->target) ||
+            (vd->step < 0.0 && vd->curdelay <= (double)vd->target))
+        {
+            vd->curdelay = (double)vd->target;
+            vd->step = 0.0;
+        }
+    }
+}
+
+void
+delay_vardelay_update(vardelay_t *vd,
+                      void *buf,
+                      int delay)
+{
+    uint32_t pos, size;
+    int n;
+
+    if (delay != vd->target && delay >= 0 && delay <= vd->maxdelay) {
+        vd->target = delay;
+        vd->step = ((double)delay - vd->curdelay) / (double)vd->ramp_length;
+    }
+
+    /* the ring is at least a block larger than the maximum delay, so the
+       whole block can be written first */
+    size = vd->mask + 1;
+    pos = vd->wpos & vd->mask;
+    n = (size - pos < (uint32_t)vd->fragsize) ? size - pos : vd->fragsize;
+    memcpy((uint8_t *)vd->ring + pos * vd->realsize, buf, n * vd->realsize);
+    memcpy(vd->ring, (uint8_t *)buf + n * vd->realsize,
+           (vd->fragsize - n) * vd->realsize);
+
+    if (vd->step != 0.0) {
+        vardelay_ramp(vd, buf);
+    } else if (vd->target != 0) {
+        pos = (vd->wpos - (uint32_t)vd->target) & vd->mask;
+        n = (size - pos < (uint32_t)vd->fragsize) ? size - pos : vd->fragsize;
+        memcpy(buf, (uint8_t *)vd->ring + pos * vd->realsize,
+               n * vd->realsize);
+        memcpy((uint8_t *)buf + n * vd->realsize, vd->ring,
+               (vd->fragsize - n) * vd->realsize);
+    }
+    vd->wpos += (uint32_t)vd->fragsize;
+}
+
+vardelay_t *
+delay_vardelay_new(int fragment_size,
+                   int initdelay,
+                   int maxdelay,
+                   int ramp_length,
+                   int _realsize)
+{
+    vardelay_t *vd;
+    int size;
+
+    vd = emalloc(sizeof(vardelay_t));
+    memset(vd, 0, sizeof(vardelay_t));
+    if (maxdelay < initdelay) {
+        /* fixed delay */
+        maxdelay = initdelay;
+    }
+    vd->fragsize = fragment_size;
+    vd->maxdelay = maxdelay;
+    vd->ramp_length = (ramp_length < 1) ? 1 : ramp_length;
+    vd->realsize = _realsize;
+    vd->target = initdelay;
+    vd->curdelay = (double)initdelay;
+    /* room for the delay, the block and the interpolator taps */
+    for (size = 1; size < maxdelay + fragment_size + 2; size <<= 1);
+    vd->mask = (uint32_t)size - 1;
+    vd->ring = emallocaligned(size * _realsize);
+    memset(vd->ring, 0, size * _realsize);
+    return vd;
+}
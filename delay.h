@@ -10,6 +10,7 @@
 #include "defs.h"
 
 typedef struct _delaybuffer_t_ delaybuffer_t;
+typedef struct _vardelay_t_ vardelay_t;
 
 /* optional_target_buf has sample_spacing == 1 */
 void
@@ -20,6 +21,17 @@ delay_update(delaybuffer_t *db,
 	     int delay,
 	     void *optional_target_buf);
 
+/* Same as delay_update() for several channels with the same sample size and
+   spacing, typically all channels of an interleaved buffer, done in one pass.
+   'db' entries may be NULL for channels without delay. */
+void
+delay_update_channels(delaybuffer_t *db[],
+                      void *bufs[],
+                      int n_channels,
+                      int sample_size,
+                      int sample_spacing,
+                      const int delays[]);
+
 delaybuffer_t *
 delay_allocate_buffer(int fragment_size,
 		      int initdelay,
@@ -41,4 +53,19 @@ delay_subsample_init(int step_count,
                      int fragment_size,
                      int _realsize);
 
+/* Delay of samples in the convolver's real format, where changes of the delay
+   are ramped linearly over 'ramp_length' samples with interpolation, instead
+   of jumping. A negative 'maxdelay' means that the delay is fixed. */
+vardelay_t *
+delay_vardelay_new(int fragment_size,
+                   int initdelay,
+                   int maxdelay,
+                   int ramp_length,
+                   int _realsize);
+
+void
+delay_vardelay_update(vardelay_t *vd,
+                      void *buf,
+                      int delay);
+
 #endif
@@ -112,6 +112,9 @@ dither_init(int n_channels,
        floating point ranging from -1.0 to +1.0, plus an offset of +0.5,
        used to make the sample truncation be mid-tread requantisation */
     dither_randmap = emallocaligned(realsize * 511);
+    emalloc_account(EMALLOC_CAT_DITHER,
+                    dither_randtab_size + realsize * 511 +
+                    n_channels * sizeof(struct dither_state));
     dither_randmap = &((uint8_t *)dither_randmap)[256 * realsize];
     if (realsize == 4) {
         ((float *)dither_randmap)[-256] = -0.5;
@@ -12,8 +12,19 @@
 #include "defs.h"
 #include "emalloc.h"
 
+struct earena {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+};
+
 static void (*exit_func)(int) = NULL;
 static int exit_status = 1;
+static size_t usage[EMALLOC_N_CATEGORIES];
+#ifdef __OS_LINUX__
+static int memtotal = 0, memused = 0;
+static size_t alloc_since_read = 0;
+#endif
 
 #define EXIT_PROGRAM if (exit_func == NULL) exit(exit_status);                 \
                      else exit_func(exit_status);
@@ -22,20 +33,22 @@ static int exit_status = 1;
     fprintf(stderr, "Memory allocation failure (%d bytes), "                   \
             "terminating program.\n", (int)size);
 
+#ifdef __OS_LINUX__
 static void
-check_avail(size_t alloc)
+read_meminfo(void)
 {
-#ifdef __OS_LINUX__
-    int memtotal, memfree, buffers, cached, allocsize, fill;
+    int memfree, buffers, cached;
     FILE *stream;
     char s[100];
 
-    /* on any error, just return ok */
+    /* on any error, memtotal is set to -1, which disables the check */
+    memtotal = memused = 0;
+    alloc_since_read = 0;
     if ((stream = fopen("/proc/meminfo", "rt")) == NULL) {
+        memtotal = -1;
         return;
     }
-    allocsize = alloc / 1024;
-    memtotal = memfree = buffers = cached = 0;
+    memfree = buffers = cached = 0;
     s[sizeof(s)-1] = '\0';
     while (fgets(s, sizeof(s)-1, stream) != NULL) {
         if (memtotal == 0 && strstr(s, "MemTotal:") == s) {
@@ -53,9 +66,31 @@ check_avail(size_t alloc)
     }
     fclose(stream);
     if (memtotal == 0 || memfree == 0) {
+        memtotal = -1;
+        return;
+    }
+    memused = memtotal - memfree - buffers - cached;
+}
+#endif
+
+/* /proc/meminfo is only read again when a significant amount of memory has
+   been allocated since the last time, in between the allocations are added
+   to the last reading */
+static void
+check_avail(size_t alloc)
+{
+#ifdef __OS_LINUX__
+    int fill;
+
+    if (memtotal == 0 || alloc_since_read / 1024 > memtotal / 64) {
+        read_meminfo();
+    }
+    if (memtotal < 0) {
         return;
     }
-    fill = 100 * (memtotal - memfree - buffers - cached + allocsize) / memtotal;
+    alloc_since_read += alloc;
+    fill = (int)(100.0 * (double)(memused + alloc_since_read / 1024) /
+                 (double)memtotal);
     if (fill > 90) {
         fprintf(stderr, "Too much (%d%%) of the available memory is allocated, "
                 "exiting\n", fill);
@@ -161,3 +196,54 @@ efree(void *p)
 {
     free(p);
 }
+
+struct earena *
+earena_new(size_t size,
+           int category)
+{
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    return earena_new_at(emallocaligned(size), size, category);
+}
+
+struct earena *
+earena_new_at(void *base,
+              size_t size,
+              int category)
+{
+    struct earena *arena;
+
+    arena = emalloc(sizeof(struct earena));
+    arena->base = base;
+    arena->size = size;
+    arena->used = 0;
+    emalloc_account(category, size);
+    return arena;
+}
+
+void *
+earena_alloc(struct earena *arena,
+             size_t size)
+{
+    void *p;
+
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (arena == NULL || arena->used + size > arena->size) {
+        return emallocaligned(size);
+    }
+    p = &arena->base[arena->used];
+    arena->used += size;
+    return p;
+}
+
+void
+emalloc_account(int category,
+                size_t size)
+{
+    usage[category] += size;
+}
+
+size_t
+emalloc_usage(int category)
+{
+    return usage[category];
+}
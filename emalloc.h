@@ -29,4 +29,38 @@ emalloc_set_exit_function(void (*exit_function)(int),
 void
 efree(void *p);
 
+/* Categories for the memory usage summary */
+#define EMALLOC_CAT_COEFFS 0
+#define EMALLOC_CAT_DELAY  1
+#define EMALLOC_CAT_DITHER 2
+#define EMALLOC_CAT_IOBUFS 3
+#define EMALLOC_N_CATEGORIES 4
+
+/* An arena reserves memory once (with a single availability check), and then
+   hands out aligned blocks from it. Blocks cannot be freed individually. If
+   the arena is exhausted or NULL, blocks are allocated with emallocaligned() */
+struct earena;
+
+struct earena *
+earena_new(size_t size,
+           int category);
+
+/* Same as earena_new(), but using already allocated (aligned) memory */
+struct earena *
+earena_new_at(void *base,
+              size_t size,
+              int category);
+
+void *
+earena_alloc(struct earena *arena,
+             size_t size);
+
+/* Add to the memory usage of a category */
+void
+emalloc_account(int category,
+                size_t size);
+
+size_t
+emalloc_usage(int category);
+
 #endif
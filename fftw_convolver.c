@@ -600,6 +600,49 @@ convolver_runtime_coeffs2cbuf(void *src,  /* nfft / 2 */
     convolver_mixnscale(&tmp, dest, &scale, 1, CONVOLVER_MIXMODE_INPUT);
 }
 
+void
+convolver_subdelay2cbuf(double delay,
+                        void *dest)
+{
+    static void *tmp = NULL;
+    double c, s, wc, ws, t, scale;
+    int n;
+
+    if (tmp == NULL) {
+        tmp = emallocaligned(n_fft * realsize);
+    }
+    /* exp(-i * 2pi * k * delay / n_fft) in halfcomplex order, the rotation is
+       accumulated to avoid calling cos() and sin() for each bin */
+    wc = cos(2.0 * M_PI * delay / (double)n_fft);
+    ws = -sin(2.0 * M_PI * delay / (double)n_fft);
+    c = 1.0;
+    s = 0.0;
+    for (n = 0; n < n_fft2; n++) {
+        if (realsize == 4) {
+            ((float *)tmp)[n] = (float)c;
+            if (n > 0) {
+                ((float *)tmp)[n_fft - n] = (float)s;
+            }
+        } else {
+            ((double *)tmp)[n] = c;
+            if (n > 0) {
+                ((double *)tmp)[n_fft - n] = s;
+            }
+        }
+        t = c * wc - s * ws;
+        s = c * ws + s * wc;
+        c = t;
+    }
+    /* the Nyquist bin must be real */
+    if (realsize == 4) {
+        ((float *)tmp)[n_fft2] = (float)cos(M_PI * delay);
+    } else {
+        ((double *)tmp)[n_fft2] = cos(M_PI * delay);
+    }
+    scale = 1.0;
+    convolver_mixnscale(&tmp, dest, &scale, 1, CONVOLVER_MIXMODE_INPUT);
+}
+
 bool_t
 convolver_verify_cbuf(void *cbufs[],
                       int n_cbufs)
@@ -5,33 +5,92 @@
  *
  */
 
-static inline real_t
-COSINE_INT_NAME(real_t mag1,
-                real_t mag2,
-                real_t freq1,
-                real_t freq2,
-                real_t curfreq)
+/* Replace the (real, zero phase) spectrum in rbuf with the minimum phase
+   spectrum having the same magnitude. The real cepstrum is made causal by
+   folding, which gives the logarithm of the minimum phase spectrum when
+   transformed back. */
+static void
+MINIMUM_PHASE_NAME(struct realtime_eq *eq)
 {
-    return (mag1 - mag2) * 0.5 *
-        cos(M_PI * (curfreq - freq1) / (freq2 - freq1)) +
-        (mag1 + mag2) * 0.5;
+    real_t *buf = (real_t *)rbuf;
+    double m, rad, divtaps, floor_mag;
+    int n, half;
+
+    half = eq->taps >> 1;
+    divtaps = 1.0 / (double)eq->taps;
+    /* -200 dB, to avoid the logarithm of zero */
+    floor_mag = 1e-10 * divtaps;
+    for (n = 0; n <= half; n++) {
+        m = fabs((double)buf[n]);
+        buf[n] = log(m > floor_mag ? m : floor_mag);
+    }
+    for (n = half + 1; n < eq->taps; n++) {
+        buf[n] = 0;
+    }
+    
+#if REALSIZE == 4
+    fftwf_execute_r2r((const fftwf_plan)eq->ifftplan, buf, buf);
+#elif REALSIZE == 8
+    fftw_execute_r2r((const fftw_plan)eq->ifftplan, buf, buf);
+#endif
+    buf[0] *= divtaps;
+    for (n = 1; n < half; n++) {
+        buf[n] *= 2.0 * divtaps;
+    }
+    buf[half] *= divtaps;
+    for (n = half + 1; n < eq->taps; n++) {
+        buf[n] = 0;
+    }
+#if REALSIZE == 4
+    fftwf_execute_r2r((const fftwf_plan)eq->fftplan, buf, buf);
+#elif REALSIZE == 8
+    fftw_execute_r2r((const fftw_plan)eq->fftplan, buf, buf);
+#endif
+
+    buf[0] = exp(buf[0]);
+    for (n = 1; n < half; n++) {
+        m = exp(buf[n]);
+        rad = buf[eq->taps-n];
+        buf[n] = m * cos(rad);
+        buf[eq->taps-n] = m * sin(rad);
+    }
+    buf[half] = exp(buf[half]);
 }
 
 static void
 RENDER_EQUALISER_NAME(struct realtime_eq *eq)
 {    
-    real_t mag, rad, curfreq, scale, divtaps, tapspi;
     real_t *eqmag, *eqfreq, *eqphase;
+    double mag, rad, curfreq, scale, divtaps, sign, signstep;
+    double w, c, cprev, cnext;
+    double cosstep2 = 0, mag_half = 0, mag_mean = 0, *pmag = NULL;
+    double phase_half = 0, phase_mean = 0;
+    bool_t flat_phase = true;
     struct timeval tv1, tv2;
     char path[1024];
     FILE *stream;
-    int n, i;
+    int n, i, slot;
+    uint8_t dummy;
 
-    /* poll until ready */
-    while (eq->not_changed) {
-        usleep(10000);
+    /* The slots form a ring, the next one after the active is rendered to as
+       soon as the filter process(es) no longer use it, that is when they have
+       picked up a later one. If it is still in use, wait for coeff_final() to
+       notify us. */
+    slot = (eq->active_slot + 1) % eq->n_slots;
+    while (eq->n_slots > 1 && slot == eq->picked_up_slot) {
+        eq->waiting = true;
+        MEMORY_BARRIER();
+        if (slot != eq->picked_up_slot) {
+            break;
+        }
+        if (!readfd(notify_pipe[0], &dummy, 1)) {
+            fprintf(stderr, "EQ: read failed.\n");
+            bfaccess->exit(BF_EXIT_OTHER);
+        }
     }
-    
+    eq->waiting = false;
+
+
     gettimeofday(&tv1, NULL);
     /* generate smoothed frequency domain filter */
     eqmag = alloca(eq->band_count * sizeof(real_t));
@@ -42,24 +101,61 @@ RENDER_EQUALISER_NAME(struct realtime_eq *eq)
         eqfreq[n] = (real_t)eq->freq[n];
         eqphase[n] = (real_t)eq->phase[n];
     }
-    scale = 1.0 / (real_t)eq->taps;
-    divtaps = 1.0 / (real_t)eq->taps;
-    tapspi = -(real_t)eq->taps * M_PI;
-    ((real_t *)rbuf)[0] = eqmag[0] * scale;
-    for (n = 1, i = 0; n < eq->taps >> 1; n++) {
-        curfreq = (real_t)n * divtaps;
-        while (curfreq > eqfreq[i+1]) {
-            i++;
+    scale = 1.0 / (double)eq->taps;
+    divtaps = 1.0 / (double)eq->taps;
+    if (eq->n_pbands > 0) {
+        pmag = parametric_response(eq);
+    }
+    ((real_t *)rbuf)[0] = eqmag[0] * scale * (pmag != NULL ? pmag[0] : 1.0);
+    /* Between two bands, magnitude and phase are cosine interpolated using the
+       same cosine, which is stepped with the recurrence
+       cos(x + d) = 2cos(d)cos(x) - cos(x - d) instead of being evaluated for
+       each bin. The linear phase part, -pi * taps * curfreq, is just an
+       alternating sign, so trigonometric functions are only needed for bins
+       where the phase is not flat. In minimum phase mode there is no linear
+       phase part, the phase is made afterwards. */
+    c = cprev = 0;
+    signstep = eq->minimum_phase ? 1.0 : -1.0;
+    for (n = 1, i = 0, sign = signstep; n < eq->taps >> 1; n++, sign *= signstep)
+    {
+        curfreq = (double)n * divtaps;
+        if (n == 1 || (real_t)curfreq > eqfreq[i+1]) {
+            while ((real_t)curfreq > eqfreq[i+1]) {
+                i++;
+            }
+            w = M_PI / ((double)eqfreq[i+1] - (double)eqfreq[i]);
+            cosstep2 = 2.0 * cos(w * divtaps);
+            c = cos(w * (curfreq - eqfreq[i]));
+            cprev = cos(w * (curfreq - divtaps - eqfreq[i]));
+            mag_half = ((double)eqmag[i] - (double)eqmag[i+1]) * 0.5;
+            mag_mean = ((double)eqmag[i] + (double)eqmag[i+1]) * 0.5;
+            phase_half = ((double)eqphase[i] - (double)eqphase[i+1]) * 0.5;
+            phase_mean = ((double)eqphase[i] + (double)eqphase[i+1]) * 0.5;
+            flat_phase = eqphase[i] == 0 && eqphase[i+1] == 0;
+        } else {
+            cnext = cosstep2 * c - cprev;
+            cprev = c;
+            c = cnext;
+        }
+        mag = (mag_half * c + mag_mean) * scale * sign;
+        if (pmag != NULL) {
+            mag *= pmag[n];
         }
-        mag = COSINE_INT_NAME(eqmag[i], eqmag[i+1], eqfreq[i], eqfreq[i+1],
-                              curfreq) * scale;
-        rad = tapspi * curfreq +
-            COSINE_INT_NAME(eqphase[i], eqphase[i+1], eqfreq[i], eqfreq[i+1],
-                            curfreq);
-        ((real_t *)rbuf)[n] = cos(rad) * mag;
-        ((real_t *)rbuf)[eq->taps-n] = sin(rad) * mag;
+        if (flat_phase) {
+            ((real_t *)rbuf)[n] = mag;
+            ((real_t *)rbuf)[eq->taps-n] = 0;
+        } else {
+            rad = phase_half * c + phase_mean;
+            ((real_t *)rbuf)[n] = cos(rad) * mag;
+            ((real_t *)rbuf)[eq->taps-n] = sin(rad) * mag;
+        }
+    }
+    ((real_t *)rbuf)[eq->taps>>1] = eqmag[eq->band_count - 1] * scale *
+        (pmag != NULL ? pmag[eq->taps>>1] : 1.0);
+
+    if (eq->minimum_phase) {
+        MINIMUM_PHASE_NAME(eq);
     }
-    ((real_t *)rbuf)[eq->taps>>1] = eqmag[eq->band_count - 1] * scale;
 
     /* convert to time-domain */
 #if REALSIZE == 4
@@ -87,16 +183,16 @@ RENDER_EQUALISER_NAME(struct realtime_eq *eq)
     for (n = 0; n < coeffs[eq->coeff[0]].n_blocks; n++) {
         bfaccess->convolver_coeffs2cbuf(&((real_t *)rbuf)[block_length * n],
                                         bfaccess->coeffs_data
-                                        [eq->coeff[!eq->active_coeff]][n]);
+                                        [eq->coeff[slot]][n]);
     }
     gettimeofday(&tv2, NULL);
     timersub(&tv2, &tv1, &tv1);
-    eq->active_coeff = !eq->active_coeff;
-    eq->not_changed = true;
+    MEMORY_BARRIER();
+    eq->active_slot = slot;
 
     if (debug) {
         fprintf(stderr, "EQ: rendering coefficient set %d took %.2f ms\n",
-                eq->coeff[eq->active_coeff],
+                eq->coeff[slot],
                 (double)tv1.tv_sec * 1000.0 + (double)tv1.tv_usec / 1000.0);
     }
 }
@@ -12,15 +12,41 @@
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/mman.h>
 #include <errno.h>
+#include <unistd.h>
 #ifdef __OS_LINUX__
 #include <malloc.h>
+#include <sys/syscall.h>
 #else
 #include <stddef.h>
 #endif
 
 #include "shmalloc.h"
 
+#if defined(__OS_LINUX__) && defined(SYS_memfd_create)
+#define HAVE_MEMFD
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB 0x0004U
+#endif
+#endif
+
+#define DEFAULT_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* populate the pages directly so they need not be faulted in one by one,
+   for transparent huge pages this is done after the advice instead */
+#ifdef MAP_POPULATE
+#define MAP_FLAGS (MAP_SHARED | MAP_POPULATE)
+#else
+#define MAP_FLAGS MAP_SHARED
+#endif
+
+static bool_t use_hugepages = false;
+static size_t hugepage_size = 0;
+static size_t total_bytes = 0;
+static size_t hugetlb_bytes = 0;
+static size_t thp_bytes = 0;
+
 static void
 print_shmget_error(size_t size)
 {
@@ -45,6 +71,102 @@ print_shmget_error(size_t size)
     }
 }
 
+#ifdef HAVE_MEMFD
+static size_t
+get_hugepage_size(void)
+{
+    unsigned long kb;
+    char line[256];
+    FILE *stream;
+
+    if ((stream = fopen("/proc/meminfo", "rt")) == NULL) {
+        return DEFAULT_HUGEPAGE_SIZE;
+    }
+    while (fgets(line, sizeof(line), stream) != NULL) {
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+            fclose(stream);
+            return (size_t)kb * 1024;
+        }
+    }
+    fclose(stream);
+    return DEFAULT_HUGEPAGE_SIZE;
+}
+
+/* Allocate shared memory from a memory file descriptor, using explicit huge
+   pages if there are any reserved, else advising transparent huge pages. The
+   mapping is inherited by forked processes like the SysV segments are. */
+static void *
+memfd_alloc(size_t size)
+{
+    bool_t hugetlb = true;
+    size_t mapsize;
+    void *p;
+    int fd;
+
+    mapsize = (size + hugepage_size - 1) & ~(hugepage_size - 1);
+    if ((fd = syscall(SYS_memfd_create, "brutefir", MFD_HUGETLB)) == -1 ||
+        ftruncate(fd, mapsize) == -1 ||
+        (p = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_FLAGS,
+                  fd, 0)) == MAP_FAILED)
+    {
+        if (fd != -1) {
+            close(fd);
+        }
+        hugetlb = false;
+        if ((fd = syscall(SYS_memfd_create, "brutefir", 0)) == -1) {
+            return NULL;
+        }
+        if (ftruncate(fd, mapsize) == -1 ||
+            (p = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0)) == MAP_FAILED)
+        {
+            close(fd);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(p, mapsize, MADV_HUGEPAGE);
+#endif
+#ifdef MADV_POPULATE_WRITE
+        madvise(p, mapsize, MADV_POPULATE_WRITE);
+#endif
+    }
+    close(fd);
+    if (hugetlb) {
+        hugetlb_bytes += mapsize;
+    } else {
+        thp_bytes += mapsize;
+    }
+    total_bytes += mapsize;
+    return p;
+}
+#endif
+
+void
+shmalloc_set_hugepages(bool_t enable)
+{
+#ifdef HAVE_MEMFD
+    use_hugepages = enable;
+    if (use_hugepages && hugepage_size == 0) {
+        hugepage_size = get_hugepage_size();
+    }
+#else
+    if (enable) {
+        fprintf(stderr, "Warning: huge pages not supported on this "
+                "platform.\n");
+    }
+#endif
+}
+
+void
+shmalloc_usage(size_t *total,
+               size_t *hugetlb,
+               size_t *thp)
+{
+    *total = total_bytes;
+    *hugetlb = hugetlb_bytes;
+    *thp = thp_bytes;
+}
+
 void *
 shmalloc(size_t size)
 {
@@ -52,6 +174,14 @@ shmalloc(size_t size)
     void *p;
     int n;
 
+#ifdef HAVE_MEMFD
+    /* small areas are not worth a huge page of their own */
+    if (use_hugepages && size >= hugepage_size / 2 &&
+        (p = memfd_alloc(size)) != NULL)
+    {
+        return p;
+    }
+#endif
     if ((n = shmget(IPC_PRIVATE, size, IPC_CREAT | SHM_R | SHM_W)) == -1) {
         print_shmget_error(size);
         return NULL;
@@ -65,6 +195,7 @@ shmalloc(size_t size)
     if (((ptrdiff_t)p & (ALIGNMENT - 1)) != 0) {
 	fprintf(stderr, "alignment error\n");
     }
+    total_bytes += size;
     return p;	
 }
 
@@ -7,6 +7,22 @@
 #ifndef _SHMALLOC_H_
 #define _SHMALLOC_H_
 
+#include <stddef.h>
+
+#include "defs.h"
+
+/* Use huge pages for large allocations made by shmalloc() if possible,
+   falling back to SysV shared memory with normal pages. */
+void
+shmalloc_set_hugepages(bool_t enable);
+
+/* Report bytes allocated by shmalloc(), and how many of them that are backed
+   by explicit huge pages and by transparent huge pages (advised) */
+void
+shmalloc_usage(size_t *total,
+               size_t *hugetlb,
+               size_t *thp);
+
 void *
 shmalloc(size_t size);
 
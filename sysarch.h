@@ -52,5 +52,10 @@
 #define __OS_GENERIC__
 #endif
 
+/*
+ * Full memory barrier, used for lock-free communication between processes
+ */
+#define MEMORY_BARRIER() __sync_synchronize()
+
 
 #endif
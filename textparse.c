@@ -0,0 +1,122 @@
+/*
+ * (c) Copyright 2026 -- Anders Torger
+ *
+ * This program is open source. For license terms, see the LICENSE file.
+ *
+ */
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "textparse.h"
+
+#define MAX_DIGITS 19
+#define MAX_EXACT_MANTISSA ((uint64_t)1 << 53)
+#define MAX_EXACT_EXPONENT 22
+
+static const double pow10_table[MAX_EXACT_EXPONENT + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static double
+slow_real(const char s[],
+          const char end[],
+          const char **endp)
+{
+    char buf[1024], *p;
+    double value;
+    int n;
+
+    /* strtod() needs a terminated string */
+    for (n = 0; n < (int)sizeof(buf) - 1 && &s[n] < end && s[n] != '\n'; n++) {
+        buf[n] = s[n];
+    }
+    buf[n] = '\0';
+    value = strtod(buf, &p);
+    *endp = &s[p - buf];
+    return value;
+}
+
+/* A number with at most 19 significant digits fits in 64 bits, and if it also
+   fits in a double's 53 bit mantissa and the power of ten is exact, a single
+   multiplication or division gives the correctly rounded result, that is the
+   same result as strtod(). Other numbers are rare in practice. */
+double
+textparse_real(const char s[],
+               const char end[],
+               const char **endp)
+{
+    const char *p, *digits;
+    uint64_t mantissa;
+    int n_digits, exponent, e, negative, e_negative;
+    double value;
+
+    p = s;
+    negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    digits = p;
+    mantissa = 0;
+    n_digits = exponent = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        if (n_digits == MAX_DIGITS) {
+            return slow_real(s, end, endp);
+        }
+        mantissa = 10 * mantissa + (uint64_t)(*p - '0');
+        if (mantissa != 0) {
+            n_digits++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (n_digits == MAX_DIGITS) {
+                return slow_real(s, end, endp);
+            }
+            mantissa = 10 * mantissa + (uint64_t)(*p - '0');
+            if (mantissa != 0) {
+                n_digits++;
+            }
+            exponent--;
+        }
+    }
+    if (p == digits || (p == digits + 1 && *digits == '.')) {
+        /* no digits, may be inf or nan */
+        return slow_real(s, end, endp);
+    }
+    if (p < end && (*p == 'x' || *p == 'X')) {
+        /* hexadecimal */
+        return slow_real(s, end, endp);
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        digits = p + 1;
+        e_negative = 0;
+        if (digits < end && (*digits == '-' || *digits == '+')) {
+            e_negative = *digits == '-';
+            digits++;
+        }
+        if (digits < end && *digits >= '0' && *digits <= '9') {
+            for (e = 0, p = digits; p < end && *p >= '0' && *p <= '9'; p++) {
+                if (e < 100000) {
+                    e = 10 * e + (*p - '0');
+                }
+            }
+            exponent += e_negative ? -e : e;
+        }
+    }
+    if (mantissa > MAX_EXACT_MANTISSA ||
+        exponent < -MAX_EXACT_EXPONENT || exponent > MAX_EXACT_EXPONENT)
+    {
+        return slow_real(s, end, endp);
+    }
+    value = (double)mantissa;
+    if (exponent < 0) {
+        value /= pow10_table[-exponent];
+    } else {
+        value *= pow10_table[exponent];
+    }
+    *endp = p;
+    return negative ? -value : value;
+}
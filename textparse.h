@@ -0,0 +1,19 @@
+/*
+ * (c) Copyright 2026 -- Anders Torger
+ *
+ * This program is open source. For license terms, see the LICENSE file.
+ *
+ */
+#ifndef _TEXTPARSE_H_
+#define _TEXTPARSE_H_
+
+/* Parse a floating point number at 's', without reading at or beyond 'end'.
+   Plain decimal numbers are converted directly, when it can be done exactly,
+   anything else is handed over to strtod(). '*endp' is set to the character
+   following the number, or to 's' if there is no number. */
+double
+textparse_real(const char s[],
+               const char end[],
+               const char **endp);
+
+#endif